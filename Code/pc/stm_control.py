@@ -5,6 +5,9 @@ from dataclasses import dataclass
 from collections import deque
 import time
 
+# Extra scan channels, in the bit order of the firmware's SCCH mask
+SCAN_CHANNELS = ["A", "Z", "AV", "AN", "AX", "ZV", "ZN", "ZX"]
+
 
 @dataclass
 class STM_Status:
@@ -18,6 +21,12 @@ class STM_Status:
     is_const_current: bool = False
     is_scanning: bool = False
     time_millis: int = 0
+    sample_rate: int = 0
+    time_micros: int = 0
+    latency_ns: int = 0
+    fault: bool = False
+    dac_writes: int = 0
+    dac_elided: int = 0
 
     @staticmethod
     def from_list(values):
@@ -30,7 +39,13 @@ class STM_Status:
                           is_approaching=bool(values[6]),
                           is_const_current=bool(values[7]),
                           is_scanning=bool(values[8]),
-                          time_millis=values[9])
+                          time_millis=values[9],
+                          sample_rate=values[10] if len(values) > 10 else 0,
+                          time_micros=values[11] if len(values) > 11 else 0,
+                          latency_ns=values[12] if len(values) > 12 else 0,
+                          fault=bool(values[13]) if len(values) > 13 else False,
+                          dac_writes=values[14] if len(values) > 14 else 0,
+                          dac_elided=values[15] if len(values) > 15 else 0)
 
     @staticmethod
     def adc_to_amp(adc: int):
@@ -63,7 +78,13 @@ STEPS: {}
 Appoaching: {} 
 ConstCurrent: {} 
 Scan: {}  
-Time: {}""".format(self.bias, self.dac_z, self.dac_x, self.dac_y, self.adc, self.steps, self.is_approaching,  self.is_const_current, self.is_scanning, self.time_millis)
+Time: {}
+Sample rate: {}
+Sample time (us): {}
+Control latency (ns): {}
+Fault: {}
+DAC writes sent: {}
+DAC writes elided: {}""".format(self.bias, self.dac_z, self.dac_x, self.dac_y, self.adc, self.steps, self.is_approaching,  self.is_const_current, self.is_scanning, self.time_millis, self.sample_rate, self.time_micros, self.latency_ns, self.fault, self.dac_writes, self.dac_elided)
 
 
 class STM(object):
@@ -82,6 +103,9 @@ class STM(object):
         self.scan_config = [0, 100, 10, 0, 100, 10]
         self.scan_adc = np.ones([512, 512], dtype=np.float32)
         self.scan_dacz = np.ones([512, 512], dtype=np.float32)
+        self.scan_line_start = np.zeros([512], dtype=np.int64)
+        self.scan_pixel_time = np.zeros([512, 512], dtype=np.int64)
+        self.scan_channel_images = {}
 
     def open(self, device):
         self.stm_serial = serial.Serial(device, 115200, timeout=1)
@@ -152,6 +176,77 @@ class STM(object):
         print(iv_curve_values)
         return iv_curve_values
 
+    def set_sample_rate(self, rate_hz):
+        self.send_cmd(f"ADCF {rate_hz}")
+
+    def set_decimation(self, decimation, compensation=True):
+        self.send_cmd(f"DECI {decimation} {int(compensation)}")
+
+    def start_stream(self, rate_hz):
+        self.send_cmd(f"STRM {rate_hz}")
+
+    def stop_stream(self):
+        self.send_cmd("STRM 0")
+
+    def capture_burst(self, n, rate_hz=250000):
+        """Records n raw ADC samples at rate_hz. Returns (adc, time_ns, header)."""
+        adc = np.zeros(0, dtype=np.int16)
+        time_ns = np.zeros(0, dtype=np.uint32)
+        header = None
+        if self.is_opened:
+            self.busy = True
+            self.send_cmd(f"BRST {n} {rate_hz}")
+            header_str = self.stm_serial.readline().decode().strip()
+            fields = header_str.split(',')
+            if fields[0] == "BR":
+                header = {"n": int(fields[1]), "rate": int(fields[2]),
+                          "start_us": int(fields[3]), "overruns": int(fields[4])}
+                count = header["n"]
+                adc = np.frombuffer(self.stm_serial.read(count * 2), dtype='<i2')
+                time_ns = np.frombuffer(
+                    self.stm_serial.read(count * 4), dtype='<u4')
+                self.stm_serial.readline()
+            self.busy = False
+        return adc, time_ns, header
+
+    def measure_noise_spectrum(self, n_avg, rate_hz=250000):
+        """Returns (frequencies in Hz, one-sided PSD in ADC counts^2/Hz)."""
+        freqs = np.zeros(0)
+        psd = np.zeros(0)
+        if self.is_opened:
+            self.busy = True
+            self.send_cmd(f"FFTM {n_avg} {rate_hz}")
+            fields = self.stm_serial.readline().decode().strip().split(',')
+            if fields[0] == "PS":
+                rate = int(fields[1])
+                size = int(fields[2])
+                window_power = int(fields[4]) / 32768.0
+                bins = np.array([int(x) for x in fields[5:]], dtype=np.float64)
+                freqs = np.arange(len(bins)) * rate / size
+                psd = 2.0 * bins / (rate * window_power)
+            self.busy = False
+        return freqs, psd
+
+    def set_overcurrent_threshold(self, threshold):
+        self.send_cmd(f"OCTH {threshold}")
+
+    def clear_fault(self):
+        self.send_cmd("FLTC")
+
+    def benchmark_dac(self, n=10000):
+        """DAC updates per second: legacy write, 24-bit frame, 4-channel batch.
+        All zero while a DAC has not been written since its reset."""
+        result = None
+        if self.is_opened:
+            self.busy = True
+            self.send_cmd(f"DBNC {n}")
+            fields = self.stm_serial.readline().decode().strip().split(',')
+            if fields[0] == "DB":
+                result = {"legacy": int(fields[1]), "frame": int(fields[2]),
+                          "batch": int(fields[3])}
+            self.busy = False
+        return result
+
     def set_bias(self, value):
         self.send_cmd(f"BIAS {value}")
 
@@ -164,15 +259,174 @@ class STM(object):
     def set_dacy(self, value):
         self.send_cmd(f"DACY {value}")
 
+    def benchmark_pid(self, n=10000):
+        """Cycles per constant-current update: double PID, fixed-point PID, and which one is built in."""
+        result = None
+        if self.is_opened:
+            self.busy = True
+            self.send_cmd(f"PIDB {n}")
+            fields = self.stm_serial.readline().decode().strip().split(',')
+            if fields[0] == "PB":
+                result = {"double": int(fields[1]), "fixed": int(fields[2]),
+                          "fixed_build": fields[3] == "1"}
+            self.busy = False
+        return result
+
+    def benchmark_log(self, n=10000):
+        """Cycles per log-current call (fast, old table, libm), table bytes and the fast log's worst error."""
+        result = None
+        if self.is_opened:
+            self.busy = True
+            self.send_cmd(f"LOGB {n}")
+            fields = self.stm_serial.readline().decode().strip().split(',')
+            if fields[0] == "LB":
+                result = {"fast": int(fields[1]), "table": int(fields[2]), "libm": int(fields[3]),
+                          "fast_bytes": int(fields[4]), "table_bytes": int(fields[5]),
+                          "max_error": int(fields[6])}
+            self.busy = False
+        return result
+
+    def set_dacxy(self, x, y):
+        self.send_cmd(f"DAXY {x} {y}")
+
+    def set_voltage(self, channel, volts):
+        """Set "x", "y", "z" or "bias" in volts; the device converts with its own range."""
+        cmd = {"x": "UVLX", "y": "UVLY", "z": "UVLZ", "bias": "UVLB"}[channel]
+        self.send_cmd(f"{cmd} {int(round(volts * 1e6))}")
+
+    def upload_piezo_model(self, axis, linear_weight=1.0, operators=(), creep_gamma=0.0,
+                           creep_tau0_ms=10, enable=True):
+        """Inverse Prandtl-Ishlinskii and creep model for axis "x" or "y", fitted offline.
+
+        operators: up to 8 (threshold in codes, weight) pairs.
+        creep_gamma: creep per decade of time, as a fraction of the step.
+        """
+        a = {"x": 0, "y": 1}[axis]
+        self.send_cmd(f"PZCL {a}")
+        self.send_cmd(f"PZW0 {a} {int(round(linear_weight * 65536))}")
+        for i, (threshold, weight) in enumerate(operators):
+            self.send_cmd(f"PZOP {a} {i} {int(threshold)} {int(round(weight * 65536))}")
+        self.send_cmd(f"PZCR {a} {int(round(creep_gamma * 65536))} {int(creep_tau0_ms)}")
+        if enable:
+            self.send_cmd(f"PZEN {a} 1")
+
+    def enable_piezo_compensation(self, axis, on=True):
+        self.send_cmd(f"PZEN {({'x': 0, 'y': 1}[axis])} {1 if on else 0}")
+
+    def set_position_x(self, position):
+        """20-bit position, DAC code * 16 plus a dithered fraction. Ignored while X has piezo compensation."""
+        self.send_cmd(f"POSX {position}")
+
+    def set_position_y(self, position):
+        """As set_position_x(); ignored while Y has piezo compensation."""
+        self.send_cmd(f"POSY {position}")
+
+    def set_position_z(self, position):
+        self.send_cmd(f"POSZ {position}")
+
+    def set_move_limits(self, rate=0, accel=0):
+        """Move slew rate in codes/s and acceleration in codes/s^2, 0 keeps a value.
+        Rates below 100 codes/s are raised to 100."""
+        self.send_cmd(f"MVCF {rate} {accel}")
+
+    def move_to(self, x, y):
+        """Move X and Y together; returns the expected duration in seconds."""
+        duration = None
+        if self.is_opened:
+            self.busy = True
+            self.send_cmd(f"MVTO {x} {y}")
+            fields = self.stm_serial.readline().decode().strip().split(',')
+            if fields[0] == "MV":
+                duration = int(fields[1]) * 1e-6
+            self.busy = False
+        return duration
+
+    def _dac_calibration_cmd(self, cmd):
+        result = None
+        if self.is_opened:
+            self.busy = True
+            self.send_cmd(cmd)
+            fields = self.stm_serial.readline().decode().strip().split(',')
+            if fields[0] == "DC":
+                result = {"channel": int(fields[1]), "calibrated": fields[2] == "1",
+                          "points": [int(v) for v in fields[3:]]}
+            self.busy = False
+        return result
+
+    def calibrate_dac(self, channel):
+        """Loopback sweep of channel 0-3 (X, Y, Z, bias) wired to the ADC input."""
+        return self._dac_calibration_cmd(f"DCAL {channel}")
+
+    def clear_dac_calibration(self, channel):
+        return self._dac_calibration_cmd(f"DCLR {channel}")
+
+    def get_dac_calibration(self, channel):
+        return self._dac_calibration_cmd(f"DCGT {channel}")
+
+    def upload_waveform(self, points):
+        """points: (x, y) DAC codes, up to 4096 of them."""
+        self.send_cmd("WFCL")
+        for x, y in points:
+            self.send_cmd(f"WFPT {x} {y}")
+
+    def play_waveform(self, rate, repeats=0):
+        """Play the uploaded table at rate points/s, repeats times (0 loops until stop)."""
+        self.send_cmd(f"WFPL {rate} {repeats}")
+
+    def stop_waveform(self):
+        self.send_cmd("WFST")
+
+    def set_scan_line_rate(self, rate):
+        """Fast-axis points per second for timer-paced scan lines, 0 for CPU-paced."""
+        self.send_cmd(f"SCLR {rate}")
+
     def turn_on_const_current(self, target_adc):
         self.send_cmd(f"CCON {target_adc}")
 
+    def set_feedback_rate(self, rate):
+        """Constant-current loop rate in Hz from a timer interrupt, 0 for the main loop.
+        The interrupt runs on decimated samples, so rates above the sample rate
+        divided by the decimation add nothing."""
+        self.send_cmd(f"CCFR {rate}")
+
     def turn_off_const_current(self):
         self.send_cmd(f"CCOF")
 
     def set_pid(self, Kp, Ki, Kd):
         self.send_cmd(f"PIDS {Kp} {Ki} {Kd}")
 
+    def autotune_current(self, amplitude=0, hysteresis=0, apply=False, rule="pi"):
+        """Relay auto-tune of the constant-current loop around the present set point.
+
+        amplitude is the relay step in Z codes and hysteresis in log-current units; 0 picks the
+        firmware defaults. rule is "pi" or "pid". Returns Ku, Tu and the proposed per-update gains,
+        or None if no oscillation was measured or the overcurrent guard tripped.
+        """
+        result = None
+        if self.is_opened:
+            self.busy = True
+            timeout = self.stm_serial.timeout
+            self.stm_serial.timeout = 6  # The experiment runs for up to 5 s
+            self.send_cmd(f"ATUN {amplitude} {hysteresis} {1 if apply else 0} {1 if rule == 'pid' else 0}")
+            fields = self.stm_serial.readline().decode().strip().split(',')
+            self.stm_serial.timeout = timeout
+            if fields[0] == "AT" and fields[1] == "1":
+                result = {"Ku": float(fields[2]), "Tu": float(fields[3]) * 1e-6, "Kp": float(fields[4]),
+                          "Ki": float(fields[5]), "Kd": float(fields[6])}
+            self.busy = False
+        return result
+
+    def set_pid_filter(self, pole=0.8, tracking=0.5):
+        """Derivative low-pass pole (0..0.99, per update) and integrator back-calculation gain (0..1)."""
+        self.send_cmd(f"PIDF {pole} {tracking}")
+
+    def set_scan_channels(self, channels):
+        """channels: names from SCAN_CHANNELS, e.g. ["A", "Z", "AV"]."""
+        mask = 0
+        for name in channels:
+            mask |= 1 << SCAN_CHANNELS.index(name)
+        self.send_cmd(f"SCCH {mask}")
+
     def start_scan(self, x_start, x_end, x_resolution, y_start, y_end, y_resolution, sample_number):
         self.busy = True
         self.scan_config = [x_start, x_end,
@@ -183,6 +437,10 @@ class STM(object):
         self.scan_adc = np.ones([x_resolution, y_resolution], dtype=np.float32)
         self.scan_dacz = np.ones(
             [x_resolution, y_resolution], dtype=np.float32)
+        self.scan_line_start = np.zeros([x_resolution], dtype=np.int64)
+        self.scan_pixel_time = np.zeros(
+            [x_resolution, y_resolution], dtype=np.int64)
+        self.scan_channel_images = {}
 
         current_line = ''
 
@@ -200,6 +458,17 @@ class STM(object):
                 data_content = data[2:]
                 data_content = [int(x) for x in data_content]
                 self.scan_dacz[x_i, :] = data_content
+            if data_type in SCAN_CHANNELS[2:]:
+                x_i = int(data[1])
+                if data_type not in self.scan_channel_images:
+                    self.scan_channel_images[data_type] = np.zeros(
+                        [x_resolution, y_resolution], dtype=np.float32)
+                self.scan_channel_images[data_type][x_i, :] = [
+                    int(x) for x in data[2:]]
+            if data_type == "T":
+                x_i = int(data[1])
+                self.scan_line_start[x_i] = int(data[2])
+                self.scan_pixel_time[x_i, :] = [int(x) for x in data[3:]]
             if data_type == "D":
                 return True
             return False
@@ -8,6 +8,9 @@ AD5761
 #include "AD5761.hpp"
 #include "SPI.h"
 
+const SPISettings AD5761::_batch_spi_settings = SPISettings(40000000, MSBFIRST, SPI_MODE2);
+AD5761Chain *AD5761::_shared_chain = nullptr;
+
 /**************************************************************************/
 /*
     Constructor
@@ -22,6 +25,14 @@ AD5761::AD5761(byte cs, uint16_t mode)
     _mode = mode;
 }
 
+AD5761::AD5761(AD5761Chain *chain, uint8_t position, uint16_t mode)
+{
+    _chain = chain;
+    _shared_chain = chain;
+    _position = position;
+    _mode = mode;
+}
+
 /**************************************************************************/
 /*
     Set the output of a single DAC channel.
@@ -30,7 +41,10 @@ AD5761::AD5761(byte cs, uint16_t mode)
 
 void AD5761::spi_init()
 {
-    pinMode(_cs, OUTPUT); // Set the SS0 pin as an output
+    if (_chain == nullptr)
+    {
+        pinMode(_cs, OUTPUT); // Set the SS0 pin as an output
+    }
     SPI.begin();          // Begin SPI hardware
     delay(100);
     reset();
@@ -48,6 +62,13 @@ void AD5761::reset()
 // SPI Manputaion
 void AD5761::write(uint8_t reg_addr_cmd, uint16_t reg_data)
 {
+    if (_chain != nullptr)
+    {
+        _chain->write_now(_position, reg_addr_cmd, reg_data);
+        _track(reg_addr_cmd, reg_data);
+        return;
+    }
+    _track(reg_addr_cmd, reg_data);
     uint8_t data[3];
     SPI.beginTransaction(_spi_settings);
     digitalWrite(_cs, LOW);
@@ -59,16 +80,178 @@ void AD5761::write(uint8_t reg_addr_cmd, uint16_t reg_data)
         SPI.transfer(data[i]);
     }
     digitalWrite(_cs, HIGH);
+    SPI.endTransaction();
+}
+
+/**************************************************************************/
+/*
+    Fast path. The whole command goes out as one 24-bit LPSPI frame, so
+    there is a single FIFO write and a single wait instead of three
+    SPI.transfer() round trips. SPI on the Teensy 4.1 is LPSPI4.
+
+    When the DACs are daisy-chained (all four, never a mix) the batch has
+    no transaction of its own: frames are queued on the chain and
+    end_batch() sends the queue in one chip-select window.
+*/
+/**************************************************************************/
+
+void AD5761::begin_batch()
+{
+    if (_shared_chain == nullptr)
+    {
+        SPI.beginTransaction(_batch_spi_settings);
+    }
+}
+
+void AD5761::end_batch()
+{
+    if (_shared_chain != nullptr)
+    {
+        _shared_chain->flush();
+        return;
+    }
+    SPI.endTransaction();
+}
+
+bool AD5761::chained()
+{
+    return _shared_chain != nullptr;
+}
+
+void AD5761::write_frame(uint8_t reg_addr_cmd, uint16_t reg_data)
+{
+    if (_chain != nullptr)
+    {
+        _chain->queue(_position, reg_addr_cmd, reg_data);
+        _track(reg_addr_cmd, reg_data);
+        return;
+    }
+    _track(reg_addr_cmd, reg_data);
+    uint32_t tcr = LPSPI4_TCR;
+    LPSPI4_TCR = (tcr & ~LPSPI_TCR_FRAMESZ(31)) | LPSPI_TCR_FRAMESZ(23);
+    digitalWriteFast(_cs, LOW);
+    LPSPI4_TDR = (static_cast<uint32_t>(reg_addr_cmd) << 16) | reg_data;
+    while (((LPSPI4_FSR >> 16) & 0x1F) == 0) // RX FIFO count
+    {
+        continue;
+    }
+    (void)LPSPI4_RDR;
+    digitalWriteFast(_cs, HIGH);
+    LPSPI4_TCR = tcr;
+}
+
+void AD5761::write_fast(uint8_t reg_addr_cmd, uint16_t reg_data)
+{
+    if (_chain != nullptr)
+    {
+        _chain->write_now(_position, reg_addr_cmd, reg_data);
+        _track(reg_addr_cmd, reg_data);
+        return;
+    }
+    begin_batch();
+    write_frame(reg_addr_cmd, reg_data);
+    end_batch();
 }
 
-void AD5761::write_volt(float voltage)
+/**************************************************************************/
+/*
+    Shadow registers. Every command that goes out is tracked, so the shadow
+    follows writes made through any path, including the overcurrent ISR.
+*/
+/**************************************************************************/
+
+bool AD5761::write_code(uint16_t code)
+{
+    code = calibrate(code);
+    if (elide(code))
+    {
+        return false;
+    }
+    write_fast(CMD_WR_UPDATE_DAC_REG, code);
+    return true;
+}
+
+void AD5761::set_calibration(const DacCalibration *calibration)
+{
+    _calibration = calibration;
+}
+
+uint16_t AD5761::calibrate(uint16_t code)
+{
+    return _calibration == nullptr ? code : _calibration->apply(code);
+}
+
+bool AD5761::elide(uint16_t code)
+{
+    if (_shadow_valid && _shadow == code)
+    {
+        _elided = _elided + 1;
+        return true;
+    }
+    return false;
+}
+
+uint16_t AD5761::shadow()
+{
+    return _shadow;
+}
+
+bool AD5761::shadow_valid()
+{
+    return _shadow_valid;
+}
+
+uint32_t AD5761::writes_issued()
+{
+    return _issued;
+}
+
+uint32_t AD5761::writes_elided()
 {
-    int set_val = (int)((voltage / 2.5 + 4) / 8 * 65536);
-    write(CMD_WR_UPDATE_DAC_REG, set_val);
+    return _elided;
+}
+
+void AD5761::_track(uint8_t reg_addr_cmd, uint16_t reg_data)
+{
+    _issued = _issued + 1;
+    switch (reg_addr_cmd)
+    {
+    case CMD_WR_TO_INPUT_REG:
+        _input_shadow = reg_data;
+        _input_valid = true;
+        break;
+    case CMD_UPDATE_DAC_REG:
+        _shadow = _input_shadow;
+        _shadow_valid = _input_valid;
+        break;
+    case CMD_WR_UPDATE_DAC_REG:
+        _shadow = reg_data;
+        _input_shadow = reg_data;
+        _shadow_valid = true;
+        _input_valid = true;
+        break;
+    case CMD_WR_CTRL_REG:
+    case CMD_SW_DATA_RESET:
+    case CMD_SW_FULL_RESET:
+        _shadow_valid = false; // Output no longer known
+        _input_valid = false;
+        break;
+    default:
+        break;
+    }
+}
+
+void AD5761::write_microvolts(int32_t microvolts)
+{
+    write_code(ad5761_code(_mode, microvolts));
 }
 
 void AD5761::read(uint8_t reg_addr_cmd)
 {
+    if (_chain != nullptr)
+    {
+        return;
+    }
     digitalWrite(_cs, LOW);
     delay(1);
     _spi_buffer[0] = SPI.transfer(reg_addr_cmd);
@@ -11,6 +11,8 @@ AD5761 library
 
 #include "Arduino.h"
 #include <SPI.h>
+#include "AD5761Chain.hpp"
+#include "DacCalibration.hpp"
 
 /* Input Shift Register Commands */
 #define CMD_NOP 0x0
@@ -30,27 +32,117 @@ AD5761 library
 #define CMD_NOP_ALT_4 0xE
 #define CMD_SW_FULL_RESET 0xF
 
+/* Output ranges, RA[2:0] of the control register */
+#define RANGE_PM_10V 0b000
+#define RANGE_0_10V 0b001
+#define RANGE_PM_5V 0b010
+#define RANGE_0_5V 0b011
+#define RANGE_M2V5_7V5 0b100
+#define RANGE_PM_3V 0b101
+#define RANGE_0_16V 0b110
+#define RANGE_0_20V 0b111
+
+/* Range limits in microvolts of a control register mode */
+constexpr int32_t ad5761_min_uv(uint16_t mode)
+{
+  return (mode & 7) == RANGE_PM_10V     ? -10000000
+         : (mode & 7) == RANGE_PM_5V    ? -5000000
+         : (mode & 7) == RANGE_M2V5_7V5 ? -2500000
+         : (mode & 7) == RANGE_PM_3V    ? -3000000
+                                        : 0;
+}
+constexpr int32_t ad5761_max_uv(uint16_t mode)
+{
+  return (mode & 7) == RANGE_PM_10V || (mode & 7) == RANGE_0_10V ? 10000000
+         : (mode & 7) == RANGE_PM_5V || (mode & 7) == RANGE_0_5V ? 5000000
+         : (mode & 7) == RANGE_M2V5_7V5                          ? 7500000
+         : (mode & 7) == RANGE_PM_3V                             ? 3000000
+         : (mode & 7) == RANGE_0_16V                             ? 16000000
+                                                                 : 20000000;
+}
+/* Codes per microvolt in Q48, so code = (uV - min) * scale >> 32 */
+constexpr int64_t ad5761_scale(uint16_t mode)
+{
+  return ((1LL << 48) + (ad5761_max_uv(mode) - ad5761_min_uv(mode)) / 2) / (ad5761_max_uv(mode) - ad5761_min_uv(mode));
+}
+constexpr uint16_t ad5761_clamp_code(int64_t code)
+{
+  return code < 0 ? 0 : code > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(code);
+}
+constexpr uint16_t ad5761_code(uint16_t mode, int32_t microvolts)
+{
+  return ad5761_clamp_code((static_cast<int64_t>(microvolts - ad5761_min_uv(mode)) * ad5761_scale(mode) + (1LL << 31)) >> 32);
+}
+constexpr int32_t ad5761_microvolts(uint16_t mode, uint16_t code)
+{
+  return ad5761_min_uv(mode) + static_cast<int32_t>((static_cast<int64_t>(code) * (ad5761_max_uv(mode) - ad5761_min_uv(mode)) + 32768) >> 16);
+}
+
+/* Conversions for a mode known at compile time, all folded to constants */
+template <uint16_t MODE>
+struct AD5761Range
+{
+  static constexpr int32_t min_uv() { return ad5761_min_uv(MODE); }
+  static constexpr int32_t max_uv() { return ad5761_max_uv(MODE); }
+  static constexpr uint16_t code(int32_t microvolts) { return ad5761_code(MODE, microvolts); }
+  static constexpr int32_t microvolts(uint16_t code) { return ad5761_microvolts(MODE, code); }
+};
+
 class AD5761
 {
 
 public:
-  // mode
+  // mode: control register value, RA[2:0] selects the output range
   // 0b0000000101000 -10V, +10V
   // 0b0000000101101 -3 to 3V
   AD5761(byte cs, uint16_t mode); // Constructor
+  AD5761(AD5761Chain *chain, uint8_t position, uint16_t mode); // Daisy-chained, position 0 nearest the Teensy
 
   void write(uint8_t reg_addr_cmd, uint16_t reg_data);
-  void write_volt(float voltage);
-  void read(uint8_t reg_addr_cmd);
+  void write_fast(uint8_t reg_addr_cmd, uint16_t reg_data); // One 24-bit frame in its own transaction
+  void write_microvolts(int32_t microvolts); // Converted with the range of this DAC's mode
+
+  // Output code with shadow-register elision: no SPI traffic when the DAC
+  // register already holds the code. Returns true when a frame was sent.
+  // The code is nominal; the calibration table, if any, is applied first.
+  bool write_code(uint16_t code);
+  void set_calibration(const DacCalibration *calibration); // nullptr for none
+  uint16_t calibrate(uint16_t code);                        // Code actually sent for a nominal code
+  bool elide(uint16_t code); // True, and counted, when the calibrated code is already in the DAC register
+  uint16_t shadow();        // Code in the DAC register, as far as the library knows
+  bool shadow_valid();      // False after a reset, until the first update
+  uint32_t writes_issued(); // Commands sent since power-up
+  uint32_t writes_elided(); // write_code() calls that sent nothing
+
+  // Batched writes: one SPI transaction around any number of write_frame()
+  // calls, on any of the AD5761s sharing the bus. On a daisy chain the
+  // frames are queued instead and end_batch() sends them as one.
+  static void begin_batch();
+  static void end_batch();
+  static bool chained(); // True when the DACs share a daisy chain
+  void write_frame(uint8_t reg_addr_cmd, uint16_t reg_data); // Only between begin_batch() and end_batch()
+  void read(uint8_t reg_addr_cmd); // Not available on a daisy chain
 
   void spi_init();
   void reset();
 
 private:
-  byte _cs;
+  byte _cs = 0;
+  AD5761Chain *_chain = nullptr;
+  const DacCalibration *_calibration = nullptr;
+  uint8_t _position = 0;
   uint16_t _mode;
   SPISettings _spi_settings = SPISettings(40000000, MSBFIRST, SPI_MODE2);
+  static const SPISettings _batch_spi_settings;
+  static AD5761Chain *_shared_chain; // Set once any AD5761 is built on a chain
   byte _spi_buffer[3];
+  volatile uint16_t _shadow = 0;
+  volatile uint16_t _input_shadow = 0;
+  volatile bool _shadow_valid = false;
+  volatile bool _input_valid = false;
+  volatile uint32_t _issued = 0;
+  volatile uint32_t _elided = 0;
+  void _track(uint8_t reg_addr_cmd, uint16_t reg_data);
 };
 
 #endif
@@ -0,0 +1,102 @@
+/**************************************************************************/
+/*
+AD5761Chain
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "AD5761Chain.hpp"
+#include "AD5761.hpp"
+
+/**************************************************************************/
+/*
+    SPI0 frame bus
+*/
+/**************************************************************************/
+
+Spi0FrameBus::Spi0FrameBus(byte cs)
+{
+    pinMode(cs, OUTPUT);
+    digitalWrite(cs, HIGH);
+    _cs = cs;
+}
+
+void Spi0FrameBus::transfer(const uint8_t *frame, size_t length)
+{
+    SPI.beginTransaction(_spi_settings);
+    digitalWriteFast(_cs, LOW);
+    SPI.transfer(frame, nullptr, length);
+    digitalWriteFast(_cs, HIGH);
+    SPI.endTransaction();
+}
+
+/**************************************************************************/
+/*
+    Constructor
+*/
+/**************************************************************************/
+
+AD5761Chain::AD5761Chain(SpiFrameBus *bus)
+{
+    _bus = bus;
+}
+
+void AD5761Chain::queue(uint8_t position, uint8_t reg_addr_cmd, uint16_t reg_data)
+{
+    if (_pending & (1 << position))
+    {
+        flush(); // Keep the earlier command for this device
+    }
+    _cmd[position] = reg_addr_cmd;
+    _data[position] = reg_data;
+    _pending |= 1 << position;
+}
+
+void AD5761Chain::flush()
+{
+    if (_pending == 0)
+    {
+        return;
+    }
+    uint8_t cmd[AD5761_CHAIN_LENGTH];
+    for (int position = 0; position < AD5761_CHAIN_LENGTH; ++position)
+    {
+        cmd[position] = (_pending & (1 << position)) ? _cmd[position] : CMD_NOP;
+    }
+    _pending = 0;
+    _send(cmd, _data);
+}
+
+void AD5761Chain::write_now(uint8_t position, uint8_t reg_addr_cmd, uint16_t reg_data)
+{
+    uint8_t cmd[AD5761_CHAIN_LENGTH];
+    uint16_t data[AD5761_CHAIN_LENGTH];
+    for (int i = 0; i < AD5761_CHAIN_LENGTH; ++i)
+    {
+        cmd[i] = CMD_NOP;
+        data[i] = 0;
+    }
+    cmd[position] = reg_addr_cmd;
+    data[position] = reg_data;
+    _send(cmd, data);
+}
+
+uint32_t AD5761Chain::frames()
+{
+    return _frames;
+}
+
+// The last device in the chain gets the first 24 bits out
+void AD5761Chain::_send(const uint8_t *cmd, const uint16_t *data)
+{
+    uint8_t frame[AD5761_CHAIN_LENGTH * AD5761_FRAME_BYTES];
+    for (int position = 0; position < AD5761_CHAIN_LENGTH; ++position)
+    {
+        uint8_t *word = &frame[(AD5761_CHAIN_LENGTH - 1 - position) * AD5761_FRAME_BYTES];
+        word[0] = cmd[position];
+        word[1] = (data[position] & 0xFF00) >> 8;
+        word[2] = (data[position] & 0x00FF) >> 0;
+    }
+    _bus->transfer(frame, sizeof(frame));
+    _frames = _frames + 1;
+}
@@ -0,0 +1,64 @@
+/**************************************************************************/
+/*
+
+Daisy-chained AD5761s on one chip select.
+
+Each device's SDO feeds the next device's SDI, so one frame of 24 bits per
+device updates the whole chain. Position 0 is the device wired to the
+Teensy's MOSI; its command is the last one shifted out. Positions with
+nothing queued receive a NOP.
+
+The frames go through an SpiFrameBus, which owns the chip select and the
+SPI transaction. MockSpiFrameBus records them instead, for the host tests
+under test/test_ad5761_chain.
+
+*/
+/**************************************************************************/
+
+#ifndef AD5761_CHAIN_H
+#define AD5761_CHAIN_H
+
+#include "Arduino.h"
+#include <SPI.h>
+
+#define AD5761_CHAIN_LENGTH 4
+#define AD5761_FRAME_BYTES 3
+
+class SpiFrameBus
+{
+public:
+  virtual ~SpiFrameBus() {}
+  virtual void transfer(const uint8_t *frame, size_t length) = 0; // One chip-select window
+};
+
+class Spi0FrameBus : public SpiFrameBus
+{
+public:
+  Spi0FrameBus(byte cs); // Constructor
+  void transfer(const uint8_t *frame, size_t length) override;
+
+private:
+  byte _cs;
+  const SPISettings _spi_settings = SPISettings(40000000, MSBFIRST, SPI_MODE2);
+};
+
+class AD5761Chain
+{
+public:
+  AD5761Chain(SpiFrameBus *bus); // Constructor
+
+  void queue(uint8_t position, uint8_t reg_addr_cmd, uint16_t reg_data); // Main thread only
+  void flush();                                                          // Send everything queued as one frame
+  void write_now(uint8_t position, uint8_t reg_addr_cmd, uint16_t reg_data); // Own frame, leaves the queue alone
+  uint32_t frames();                                                     // Frames sent so far
+
+private:
+  SpiFrameBus *_bus;
+  uint8_t _cmd[AD5761_CHAIN_LENGTH];
+  uint16_t _data[AD5761_CHAIN_LENGTH];
+  uint8_t _pending = 0; // Bit mask of queued positions
+  volatile uint32_t _frames = 0;
+  void _send(const uint8_t *cmd, const uint16_t *data);
+};
+
+#endif // AD5761_CHAIN_H
@@ -0,0 +1,67 @@
+/**************************************************************************/
+/*
+
+Recording SpiFrameBus for host-side checks of the AD5761 chain wiring.
+
+Keeps the most recent frames, oldest first, and decodes the 24-bit word a
+given chain position received.
+
+*/
+/**************************************************************************/
+
+#ifndef MOCK_SPI_FRAME_BUS_H
+#define MOCK_SPI_FRAME_BUS_H
+
+#include "AD5761Chain.hpp"
+
+#define MOCK_SPI_FRAMES 16
+
+class MockSpiFrameBus : public SpiFrameBus
+{
+public:
+    void transfer(const uint8_t *frame, size_t length) override
+    {
+        if (_count == MOCK_SPI_FRAMES)
+        {
+            for (int i = 1; i < MOCK_SPI_FRAMES; ++i)
+            {
+                memcpy(_frames[i - 1], _frames[i], sizeof(_frames[i]));
+                _lengths[i - 1] = _lengths[i];
+            }
+            _count--;
+        }
+        size_t n = length < sizeof(_frames[0]) ? length : sizeof(_frames[0]);
+        memcpy(_frames[_count], frame, n);
+        _lengths[_count] = n;
+        _count++;
+    }
+
+    int count() { return _count; }
+    size_t length(int index) { return _lengths[index]; }
+    const uint8_t *frame(int index) { return _frames[index]; }
+
+    // Command nibble and data word the device at position received in frame index
+    uint8_t command(int index, int position)
+    {
+        return _word(index, position)[0];
+    }
+    uint16_t data(int index, int position)
+    {
+        const uint8_t *word = _word(index, position);
+        return (static_cast<uint16_t>(word[1]) << 8) | word[2];
+    }
+    void clear() { _count = 0; }
+
+private:
+    uint8_t _frames[MOCK_SPI_FRAMES][AD5761_CHAIN_LENGTH * AD5761_FRAME_BYTES];
+    size_t _lengths[MOCK_SPI_FRAMES];
+    int _count = 0;
+
+    const uint8_t *_word(int index, int position)
+    {
+        int words = static_cast<int>(_lengths[index] / AD5761_FRAME_BYTES);
+        return &_frames[index][(words - 1 - position) * AD5761_FRAME_BYTES];
+    }
+};
+
+#endif // MOCK_SPI_FRAME_BUS_H
@@ -0,0 +1,134 @@
+/**************************************************************************/
+/*
+CicDecimator
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "CicDecimator.hpp"
+
+/**************************************************************************/
+/*
+    Constructor
+*/
+/**************************************************************************/
+
+CicDecimator::CicDecimator()
+{
+    set_decimation(1);
+}
+
+void CicDecimator::set_decimation(uint32_t decimation)
+{
+    if (decimation < 1)
+    {
+        decimation = 1;
+    }
+    if (decimation > CIC_MAX_DECIMATION)
+    {
+        decimation = CIC_MAX_DECIMATION;
+    }
+    _decimation = decimation;
+    uint64_t gain = static_cast<uint64_t>(decimation) * decimation * decimation;
+    _gain_reciprocal = decimation > 1 ? static_cast<uint32_t>(((1ULL << 32) + gain / 2) / gain) : 0;
+    reset();
+}
+
+uint32_t CicDecimator::decimation()
+{
+    return _decimation;
+}
+
+void CicDecimator::set_compensation(bool enabled)
+{
+    _compensation = enabled;
+    reset();
+}
+
+bool CicDecimator::compensation()
+{
+    return _compensation;
+}
+
+void CicDecimator::reset()
+{
+    for (int i = 0; i < CIC_ORDER; ++i)
+    {
+        _integrator[i] = 0;
+        _comb[i] = 0;
+    }
+    _fir[0] = 0;
+    _fir[1] = 0;
+    _phase = 0;
+    _outputs = 0;
+}
+
+/**************************************************************************/
+/*
+    The CIC impulse response spans N * (R - 1) + 1 inputs, so its N-th
+    output after a reset is the first that sees only real samples. The FIR
+    needs two settled CIC outputs before its own.
+*/
+/**************************************************************************/
+
+uint32_t CicDecimator::_settle_outputs()
+{
+    return _compensation ? CIC_ORDER + 2 : CIC_ORDER;
+}
+
+uint32_t CicDecimator::settle_samples()
+{
+    return _decimation == 1 ? 1 : _settle_outputs() * _decimation;
+}
+
+/**************************************************************************/
+/*
+    Integrators run on every input, combs on every R-th. With R = 1 the
+    sample passes straight through.
+*/
+/**************************************************************************/
+
+bool CicDecimator::push(int16_t sample, int32_t &output)
+{
+    if (_decimation == 1)
+    {
+        output = sample;
+        return true;
+    }
+    uint32_t acc = static_cast<uint32_t>(static_cast<int32_t>(sample));
+    for (int i = 0; i < CIC_ORDER; ++i)
+    {
+        _integrator[i] += acc;
+        acc = _integrator[i];
+    }
+    if (++_phase < _decimation)
+    {
+        return false;
+    }
+    _phase = 0;
+    for (int i = 0; i < CIC_ORDER; ++i)
+    {
+        uint32_t delayed = _comb[i];
+        _comb[i] = acc;
+        acc -= delayed;
+    }
+    // Remove the R^3 gain; the sign survives the 64-bit multiply
+    int32_t cic = static_cast<int32_t>((static_cast<int64_t>(static_cast<int32_t>(acc)) * _gain_reciprocal) >> 32);
+    int32_t result = cic;
+    if (_compensation)
+    {
+        // Taps (-1, 10, -1) / 8 on the decimated stream
+        result = (10 * _fir[0] - _fir[1] - cic) >> 3;
+        _fir[1] = _fir[0];
+        _fir[0] = cic;
+    }
+    if (_outputs < _settle_outputs())
+    {
+        if (++_outputs < _settle_outputs())
+        {
+            return false; // Still reaches back before the reset
+        }
+    }
+    output = result;
+    return true;
+}
@@ -0,0 +1,58 @@
+/**************************************************************************/
+/*
+
+Third-order CIC decimator with an optional three-tap compensating FIR.
+
+Runs at the raw ADC rate and produces one sample every R inputs. Everything
+is integer arithmetic: the CIC gain R^3 is removed with a precomputed
+reciprocal, and the FIR taps are (-1, 10, -1) / 8, which flattens most of
+the CIC passband droop.
+
+The filter only makes sense on consecutive conversions. After reset() the
+outputs whose response still reaches back into the zeroed state are
+withheld: push() first returns true after settle_samples() inputs, so a
+caller that restarts on a gap gets a fully settled value or none.
+
+*/
+/**************************************************************************/
+
+#ifndef CIC_DECIMATOR_H
+#define CIC_DECIMATOR_H
+
+#include <Arduino.h>
+
+#define CIC_ORDER 3
+#define CIC_MAX_DECIMATION 32 // 16 + 3 * log2(32) = 31 bits, fits the 32-bit registers
+
+class CicDecimator
+{
+public:
+    CicDecimator();
+
+    void set_decimation(uint32_t decimation); // 1 .. CIC_MAX_DECIMATION, 1 bypasses the filter
+    uint32_t decimation();
+    void set_compensation(bool enabled);
+    bool compensation();
+    void reset();
+    uint32_t settle_samples(); // Inputs from reset() to the first output
+
+
+    bool push(int16_t sample, int32_t &output); // True when a decimated output is ready
+
+private:
+    uint32_t _decimation = 1;
+    uint32_t _gain_reciprocal = 0; // 2^32 / R^3
+    bool _compensation = true;
+    uint32_t _phase = 0;
+    uint32_t _outputs = 0; // Decimated outputs since reset(), up to the settled count
+
+    // Registers wrap modulo 2^32, which is harmless for a CIC
+    uint32_t _integrator[CIC_ORDER];
+    uint32_t _comb[CIC_ORDER];
+
+    int32_t _fir[2]; // Two previous CIC outputs
+
+    uint32_t _settle_outputs();
+};
+
+#endif // CIC_DECIMATOR_H
@@ -0,0 +1,139 @@
+/**************************************************************************/
+/*
+
+Fixed-point ADC filters, configured at compile time.
+
+    BoxcarFilter<LOG2_N>  moving average of 2^LOG2_N samples
+    EmaFilter<SHIFT>      exponential average, alpha = 2^-SHIFT
+    MedianFilter<K>       median of the last K samples, K odd
+
+All of them take and return ADC codes in int32_t and use only integer
+adds, shifts and compares. Each consumer of the ADC owns its own instance.
+
+*/
+/**************************************************************************/
+
+#ifndef FILTER_BANK_H
+#define FILTER_BANK_H
+
+#include <Arduino.h>
+
+template <unsigned LOG2_N>
+class BoxcarFilter
+{
+public:
+    static const unsigned LENGTH = 1u << LOG2_N;
+
+    BoxcarFilter() { reset(); }
+    void reset()
+    {
+        for (unsigned i = 0; i < LENGTH; ++i)
+        {
+            _buffer[i] = 0;
+        }
+        _sum = 0;
+        _index = 0;
+        _primed = false;
+    }
+    int32_t push(int32_t sample)
+    {
+        if (!_primed)
+        {
+            // Fill the window with the first sample instead of ramping up from zero
+            for (unsigned i = 0; i < LENGTH; ++i)
+            {
+                _buffer[i] = sample;
+            }
+            _sum = sample * (1 << LOG2_N);
+            _primed = true;
+        }
+        _sum += sample - _buffer[_index];
+        _buffer[_index] = sample;
+        _index = (_index + 1) & (LENGTH - 1);
+        return value();
+    }
+    int32_t value() const { return _sum >> LOG2_N; }
+
+private:
+    int32_t _buffer[LENGTH];
+    int32_t _sum;
+    unsigned _index;
+    bool _primed;
+};
+
+template <unsigned SHIFT>
+class EmaFilter
+{
+public:
+    EmaFilter() { reset(); }
+    void reset()
+    {
+        _state = 0;
+        _primed = false;
+    }
+    int32_t push(int32_t sample)
+    {
+        if (!_primed)
+        {
+            // Start at the first sample instead of ramping up from zero
+            _state = sample * (1 << SHIFT);
+            _primed = true;
+        }
+        else
+        {
+            _state += sample - (_state >> SHIFT);
+        }
+        return value();
+    }
+    int32_t value() const { return _state >> SHIFT; }
+
+private:
+    int32_t _state; // Average scaled by 2^SHIFT
+    bool _primed;
+};
+
+template <unsigned K>
+class MedianFilter
+{
+    static_assert(K % 2 == 1, "MedianFilter length must be odd");
+
+public:
+    MedianFilter() { reset(); }
+    void reset()
+    {
+        for (unsigned i = 0; i < K; ++i)
+        {
+            _buffer[i] = 0;
+        }
+        _index = 0;
+        _median = 0;
+    }
+    int32_t push(int32_t sample)
+    {
+        _buffer[_index] = sample;
+        _index = (_index + 1) % K;
+        int32_t sorted[K];
+        for (unsigned i = 0; i < K; ++i)
+        {
+            // Insertion sort, K is small
+            int32_t v = _buffer[i];
+            unsigned j = i;
+            while (j > 0 && sorted[j - 1] > v)
+            {
+                sorted[j] = sorted[j - 1];
+                j--;
+            }
+            sorted[j] = v;
+        }
+        _median = sorted[K / 2];
+        return _median;
+    }
+    int32_t value() const { return _median; }
+
+private:
+    int32_t _buffer[K];
+    unsigned _index;
+    int32_t _median;
+};
+
+#endif // FILTER_BANK_H
@@ -0,0 +1,162 @@
+/**************************************************************************/
+/*
+AdcStream
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "AdcStream.hpp"
+
+/**************************************************************************/
+/*
+    Constructor
+*/
+/**************************************************************************/
+
+AdcStream::AdcStream(AdcStreamBackend *backend)
+{
+    _backend = backend;
+}
+
+/**************************************************************************/
+/*
+    Start and stop the acquisition.
+*/
+/**************************************************************************/
+
+bool AdcStream::begin(uint32_t rate_hz)
+{
+    if (_running)
+    {
+        end();
+    }
+    flush();
+    _running = _backend->start(this, rate_hz);
+    return _running;
+}
+
+void AdcStream::end()
+{
+    if (_running)
+    {
+        _backend->stop();
+    }
+    _running = false;
+}
+
+bool AdcStream::running()
+{
+    return _running;
+}
+
+uint32_t AdcStream::rate_hz()
+{
+    return _running ? _backend->rate_hz() : 0;
+}
+
+/**************************************************************************/
+/*
+    Consumer side. The producer never waits for the consumer, so the slot
+    under _head may be overwritten at any time; pop() therefore keeps at most
+    ADC_STREAM_LENGTH - 1 samples and counts everything older as overrun.
+*/
+/**************************************************************************/
+
+uint32_t AdcStream::available()
+{
+    uint32_t pending = _head - _tail;
+    if (pending > ADC_STREAM_LENGTH - 1)
+    {
+        pending = ADC_STREAM_LENGTH - 1;
+    }
+    return pending;
+}
+
+bool AdcStream::pop(int16_t &value)
+{
+    uint32_t cycles;
+    return pop(value, cycles);
+}
+
+bool AdcStream::pop(int16_t &value, uint32_t &cycles)
+{
+    uint32_t head = _head;
+    if (head == _tail)
+    {
+        return false;
+    }
+    if (head - _tail > ADC_STREAM_LENGTH - 1)
+    {
+        _overruns += head - _tail - (ADC_STREAM_LENGTH - 1);
+        _tail = head - (ADC_STREAM_LENGTH - 1);
+    }
+    value = static_cast<int16_t>(_buffer[_tail & ADC_STREAM_MASK]);
+    cycles = _stamps[_tail & ADC_STREAM_MASK];
+    _tail++;
+    return true;
+}
+
+bool AdcStream::wait_next(int16_t &value, uint32_t timeout_us)
+{
+    uint32_t cycles;
+    return wait_next(value, cycles, timeout_us);
+}
+
+bool AdcStream::wait_next(int16_t &value, uint32_t &cycles, uint32_t timeout_us)
+{
+    uint32_t start_time = micros();
+    while (_head == _seen)
+    {
+        if (micros() - start_time > timeout_us)
+        {
+            return false;
+        }
+    }
+    _seen = _head;
+    value = static_cast<int16_t>(_buffer[(_seen - 1) & ADC_STREAM_MASK]);
+    cycles = _stamps[(_seen - 1) & ADC_STREAM_MASK];
+    return true;
+}
+
+int16_t AdcStream::latest()
+{
+    return static_cast<int16_t>(_buffer[(_head - 1) & ADC_STREAM_MASK]);
+}
+
+int16_t AdcStream::latest(uint32_t &seq, uint32_t &cycles)
+{
+    int16_t val;
+    do
+    {
+        seq = _head;
+        val = static_cast<int16_t>(_buffer[(seq - 1) & ADC_STREAM_MASK]);
+        cycles = _stamps[(seq - 1) & ADC_STREAM_MASK];
+    } while (seq != _head);
+    return val;
+}
+
+uint32_t AdcStream::sequence()
+{
+    return _head;
+}
+
+uint32_t AdcStream::overruns()
+{
+    return _overruns;
+}
+
+void AdcStream::skip_to(uint32_t keep)
+{
+    uint32_t head = _head;
+    if (head - _tail > keep)
+    {
+        _tail = head - keep;
+    }
+}
+
+void AdcStream::flush()
+{
+    _tail = _head;
+    _seen = _head;
+    _overruns = 0;
+}
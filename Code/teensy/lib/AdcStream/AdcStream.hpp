@@ -0,0 +1,78 @@
+/**************************************************************************/
+/*
+
+Continuous ADC acquisition into a ring buffer.
+
+A backend paces the conversions and moves every result into the slot handed
+out by slot(), then publishes it with commit(). The control and scan code
+consume from the ring without touching the ADC themselves. Every sample
+carries the DWT cycle count at which its conversion started.
+
+Ltc2326DmaBackend drives the real ADC; MockAdcBackend stands in for it in
+the host tests under test/test_adc_stream.
+
+*/
+/**************************************************************************/
+
+#ifndef ADC_STREAM_H
+#define ADC_STREAM_H
+
+#include <Arduino.h>
+
+#define ADC_STREAM_LENGTH 4096 // Ring length in samples, must be a power of two
+#define ADC_STREAM_MASK (ADC_STREAM_LENGTH - 1)
+
+class AdcStream;
+
+class AdcStreamBackend
+{
+public:
+    virtual ~AdcStreamBackend() {}
+    virtual bool start(AdcStream *stream, uint32_t rate_hz) = 0; // Begin filling the stream
+    virtual void stop() = 0;                                     // Stop after the current sample
+    virtual uint32_t rate_hz() = 0;                              // Rate actually used
+};
+
+class AdcStream
+{
+public:
+    AdcStream(AdcStreamBackend *backend); // Constructor
+
+    bool begin(uint32_t rate_hz); // Start continuous acquisition
+    void end();                   // Stop continuous acquisition
+    bool running();
+    uint32_t rate_hz();
+
+    // Consumer side
+    uint32_t available();                              // Samples not yet consumed by pop()
+    bool pop(int16_t &value);                          // Oldest unread sample, in order
+    bool pop(int16_t &value, uint32_t &cycles);
+    bool wait_next(int16_t &value, uint32_t timeout_us); // Newest sample, waits for one not seen before
+    bool wait_next(int16_t &value, uint32_t &cycles, uint32_t timeout_us);
+    int16_t latest();                                  // Newest sample without waiting
+    int16_t latest(uint32_t &seq, uint32_t &cycles);   // ... with its sequence number and CNV cycle count
+    uint32_t sequence();                               // Number of samples produced so far
+    uint32_t overruns();                               // Samples dropped because pop() fell behind
+    void flush();                                      // Discard everything produced so far
+    void skip_to(uint32_t keep);                       // Discard all but the newest keep unread samples
+
+    // Producer side, called by the backend (usually from an ISR)
+    volatile uint16_t *slot() { return &_buffer[_head & ADC_STREAM_MASK]; }
+    void commit(uint32_t cycles)
+    {
+        _stamps[_head & ADC_STREAM_MASK] = cycles;
+        _head = _head + 1;
+    }
+
+private:
+    AdcStreamBackend *_backend;
+    volatile uint16_t _buffer[ADC_STREAM_LENGTH];
+    volatile uint32_t _stamps[ADC_STREAM_LENGTH];
+    volatile uint32_t _head = 0; // Written by the producer only
+    uint32_t _tail = 0;          // Read position of pop()
+    uint32_t _seen = 0;          // Read position of wait_next()
+    uint32_t _overruns = 0;
+    bool _running = false;
+};
+
+#endif // ADC_STREAM_H
@@ -0,0 +1,133 @@
+/**************************************************************************/
+/*
+LTC2326-16 DMA stream backend
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "Ltc2326DmaBackend.hpp"
+
+Ltc2326DmaBackend *Ltc2326DmaBackend::_active = nullptr;
+
+/**************************************************************************/
+/*
+    Constructor
+*/
+/**************************************************************************/
+
+Ltc2326DmaBackend::Ltc2326DmaBackend(byte cs, byte cnv, SampleClock *clock)
+{
+    _cs = cs;
+    _cnv = cnv;
+    _clock = clock;
+}
+
+/**************************************************************************/
+/*
+    Start the stream. SPI1 stays inside one transaction for as long as the
+    stream runs, with the frame size set to a single 16-bit word.
+*/
+/**************************************************************************/
+
+bool Ltc2326DmaBackend::start(AdcStream *stream, uint32_t rate_hz)
+{
+    _stream = stream;
+    _active = this;
+    _pending = false;
+    _missed = 0;
+
+    SPI1.beginTransaction(_spi_settings);
+    _saved_tcr = LPSPI3_TCR;
+    LPSPI3_TCR = (_saved_tcr & ~LPSPI_TCR_FRAMESZ(31)) | LPSPI_TCR_FRAMESZ(15);
+
+    _rx_dma.begin(true);
+    _rx_dma.source((volatile uint16_t &)LPSPI3_RDR);
+    _rx_dma.transferSize(2);
+    _rx_dma.transferCount(1);
+    _rx_dma.triggerAtHardwareEvent(DMAMUX_SOURCE_LPSPI3_RX);
+    _rx_dma.disableOnCompletion();
+    _rx_dma.interruptAtCompletion();
+    _rx_dma.attachInterrupt(_rx_isr);
+    LPSPI3_DER = LPSPI_DER_RDDE;
+
+    // Start the first conversion so the first tick has a result to read
+    digitalWriteFast(_cs, LOW);
+    digitalWriteFast(_cnv, HIGH);
+    _cnv_cycles = CycleClock::now();
+    return _clock->begin(_tick_isr, rate_hz);
+}
+
+void Ltc2326DmaBackend::stop()
+{
+    _clock->end();
+    _rx_dma.disable();
+    _rx_dma.detachInterrupt();
+    LPSPI3_DER = 0;
+    LPSPI3_TCR = _saved_tcr;
+    SPI1.endTransaction();
+    _active = nullptr;
+    _stream = nullptr;
+    // Leave a conversion running, as LTC2326_16::convert() would
+    digitalWriteFast(_cs, LOW);
+    digitalWriteFast(_cnv, HIGH);
+}
+
+uint32_t Ltc2326DmaBackend::rate_hz()
+{
+    return _clock->rate_hz();
+}
+
+uint32_t Ltc2326DmaBackend::missed()
+{
+    return _missed;
+}
+
+IRQ_NUMBER_t Ltc2326DmaBackend::irq()
+{
+    // Channels n and n + 16 share one interrupt
+    return static_cast<IRQ_NUMBER_t>(IRQ_DMA_CH0 + (_rx_dma.channel & 15));
+}
+
+void Ltc2326DmaBackend::set_sample_hook(void (*hook)(int16_t))
+{
+    _sample_hook = hook;
+}
+
+/**************************************************************************/
+/*
+    Interrupt handlers. The sequence matches LTC2326_16::read() followed by
+    LTC2326_16::convert(), with the transfer itself handed to DMA.
+*/
+/**************************************************************************/
+
+void Ltc2326DmaBackend::_tick_isr()
+{
+    Ltc2326DmaBackend *self = _active;
+    if (self->_pending)
+    {
+        self->_missed = self->_missed + 1;
+        return;
+    }
+    self->_pending = true;
+    digitalWriteFast(self->_cnv, LOW);
+    self->_rx_dma.destination(*self->_stream->slot());
+    self->_rx_dma.enable();
+    digitalWriteFast(self->_cs, HIGH);
+    LPSPI3_TDR = 0;
+}
+
+void Ltc2326DmaBackend::_rx_isr()
+{
+    Ltc2326DmaBackend *self = _active;
+    self->_rx_dma.clearInterrupt();
+    digitalWriteFast(self->_cs, LOW);
+    int16_t sample = static_cast<int16_t>(*self->_stream->slot());
+    self->_stream->commit(self->_cnv_cycles);
+    digitalWriteFast(self->_cnv, HIGH);
+    self->_cnv_cycles = CycleClock::now();
+    self->_pending = false;
+    if (self->_sample_hook != nullptr)
+    {
+        self->_sample_hook(sample);
+    }
+}
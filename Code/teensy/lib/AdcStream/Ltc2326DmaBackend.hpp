@@ -0,0 +1,53 @@
+/**************************************************************************/
+/*
+
+LTC2326-16 stream backend for Teensy 4.1.
+
+The SampleClock ends each conversion and starts the SPI1 (LPSPI3) read of its
+result. DMA moves the 16-bit word from the receive FIFO straight into the
+AdcStream ring; its completion interrupt starts the next conversion.
+
+*/
+/**************************************************************************/
+
+#ifndef LTC2326_DMA_BACKEND_H
+#define LTC2326_DMA_BACKEND_H
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <DMAChannel.h>
+#include "AdcStream.hpp"
+#include "SampleClock.hpp"
+#include "CycleClock.hpp"
+
+class Ltc2326DmaBackend : public AdcStreamBackend
+{
+public:
+  Ltc2326DmaBackend(byte cs, byte cnv, SampleClock *clock); // Constructor
+
+  bool start(AdcStream *stream, uint32_t rate_hz) override;
+  void stop() override;
+  uint32_t rate_hz() override;
+  uint32_t missed(); // Ticks skipped because the previous read had not finished
+  IRQ_NUMBER_t irq(); // Interrupt that publishes the samples
+  void set_sample_hook(void (*hook)(int16_t)); // Called from the ISR with every sample
+
+private:
+  byte _cs;
+  byte _cnv;
+  AdcStream *_stream = nullptr;
+  SampleClock *_clock;
+  DMAChannel _rx_dma;
+  uint32_t _saved_tcr = 0;
+  volatile bool _pending = false;
+  void (*_sample_hook)(int16_t) = nullptr;
+  volatile uint32_t _cnv_cycles = 0; // Start of the conversion being read
+  volatile uint32_t _missed = 0;
+  const SPISettings _spi_settings = SPISettings(40000000, MSBFIRST, SPI_MODE2);
+
+  static Ltc2326DmaBackend *_active;
+  static void _tick_isr();
+  static void _rx_isr();
+};
+
+#endif // LTC2326_DMA_BACKEND_H
@@ -0,0 +1,90 @@
+/**************************************************************************/
+/*
+
+Host-side stand-in for Ltc2326DmaBackend.
+
+tick() plays the part of the sample timer: it clocks one word out of the
+mocked SPI receive FIFO. complete() plays the part of the DMA transfer and
+its completion interrupt. Keeping the two apart lets a test check what the
+consumer sees while a transfer is still in flight.
+
+*/
+/**************************************************************************/
+
+#ifndef MOCK_ADC_BACKEND_H
+#define MOCK_ADC_BACKEND_H
+
+#include "AdcStream.hpp"
+
+class MockAdcBackend : public AdcStreamBackend
+{
+public:
+    typedef int16_t (*SampleSource)(uint32_t index);
+
+    MockAdcBackend(SampleSource source, uint32_t cycles_per_sample = 6000)
+        : _source(source), _cycles_per_sample(cycles_per_sample) {}
+
+    bool start(AdcStream *stream, uint32_t rate_hz) override
+    {
+        _stream = stream;
+        _rate_hz = rate_hz;
+        _pending = false;
+        return true;
+    }
+    void stop() override
+    {
+        _stream = nullptr;
+    }
+
+    // Timer tick: start the SPI read of the current conversion
+    bool tick()
+    {
+        if (_stream == nullptr || _pending)
+        {
+            _missed++;
+            return false;
+        }
+        _rx_fifo = static_cast<uint16_t>(_source(_index));
+        _cycles = _index * _cycles_per_sample;
+        _index++;
+        _pending = true;
+        return true;
+    }
+    // DMA completion: move the word into the ring and publish it
+    bool complete()
+    {
+        if (_stream == nullptr || !_pending)
+        {
+            return false;
+        }
+        *_stream->slot() = _rx_fifo;
+        _stream->commit(_cycles);
+        _pending = false;
+        return true;
+    }
+    // One full sample period
+    void run(uint32_t samples)
+    {
+        for (uint32_t i = 0; i < samples; ++i)
+        {
+            tick();
+            complete();
+        }
+    }
+
+    uint32_t rate_hz() override { return _rate_hz; }
+    uint32_t missed() { return _missed; }
+
+private:
+    SampleSource _source;
+    AdcStream *_stream = nullptr;
+    uint32_t _rate_hz = 0;
+    uint32_t _cycles_per_sample;
+    uint32_t _cycles = 0;
+    uint32_t _index = 0;
+    uint32_t _missed = 0;
+    uint16_t _rx_fifo = 0;
+    bool _pending = false;
+};
+
+#endif // MOCK_ADC_BACKEND_H
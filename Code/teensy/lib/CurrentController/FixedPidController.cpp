@@ -0,0 +1,137 @@
+/**************************************************************************/
+/*
+FixedPidController
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "FixedPidController.hpp"
+
+int32_t FixedPidController::saturate(int64_t value)
+{
+    if (value > INT32_MAX)
+    {
+        return INT32_MAX;
+    }
+    if (value < INT32_MIN)
+    {
+        return INT32_MIN;
+    }
+    return static_cast<int32_t>(value);
+}
+
+int64_t FixedPidController::_limit(int64_t value, int64_t limit)
+{
+    if (value > limit)
+    {
+        return limit;
+    }
+    if (value < -limit)
+    {
+        return -limit;
+    }
+    return value;
+}
+
+int64_t FixedPidController::_magnitude(int64_t value)
+{
+    return value < 0 ? -value : value;
+}
+
+int32_t FixedPidController::_to_q16(double gain)
+{
+    double scaled = gain * 65536.0;
+    if (scaled >= 2147483647.0)
+    {
+        return INT32_MAX;
+    }
+    if (scaled <= -2147483648.0)
+    {
+        return INT32_MIN;
+    }
+    return static_cast<int32_t>(scaled >= 0 ? scaled + 0.5 : scaled - 0.5);
+}
+
+void FixedPidController::set_gains(double kp, double ki, double kd)
+{
+    _kp_q16 = _to_q16(kp);
+    _ki_q16 = _to_q16(ki);
+    _kd_q16 = _to_q16(kd);
+}
+
+void FixedPidController::set_filter(double pole, double tracking)
+{
+    _pole_q16 = _to_q16(pole < 0.0 ? 0.0 : pole > 0.99 ? 0.99 : pole);
+    _tracking_q16 = _to_q16(tracking < 0.0 ? 0.0 : tracking > 1.0 ? 1.0 : tracking);
+}
+
+void FixedPidController::set_limits(int32_t low, int32_t high)
+{
+    _low = low;
+    _high = high;
+}
+
+void FixedPidController::engage(int32_t output)
+{
+    _engage_output = output;
+    _engage = true;
+}
+
+/**************************************************************************/
+/*
+    One update. The products are 32 x 32 -> 64 bit, so they cannot overflow;
+    the results are brought back to int32 with saturation.
+*/
+/**************************************************************************/
+
+int32_t FixedPidController::update(int32_t setpoint, int32_t measurement)
+{
+    const int64_t integral_limit = static_cast<int64_t>(FIXED_PID_INTEGRAL_LIMIT) << 16;
+    const int64_t derivative_limit = static_cast<int64_t>(FIXED_PID_DERIVATIVE_LIMIT) << 16;
+    int32_t error = saturate(static_cast<int64_t>(setpoint) - measurement);
+    _p_term = saturate((static_cast<int64_t>(_kp_q16) * error) >> 16);
+    if (_engage)
+    {
+        _last_measurement = measurement;
+        _derivative_q16 = 0;
+    }
+    // One-pole low pass of Kd * (-d measurement)
+    int64_t slope = static_cast<int64_t>(_last_measurement) - measurement;
+    int64_t target_q16 = _limit(static_cast<int64_t>(_kd_q16) * slope, derivative_limit);
+    _derivative_q16 += ((target_q16 - _derivative_q16) * (65536 - _pole_q16)) >> 16;
+    _last_measurement = measurement;
+    if (_engage)
+    {
+        _integral_q16 = (static_cast<int64_t>(_engage_output) - _p_term) * 65536 - _derivative_q16;
+        _integral_limit_q16 = _magnitude(_integral_q16); // Room for the seed, so this update returns it exactly
+        _engage = false;
+    }
+    else
+    {
+        _integral_q16 += static_cast<int64_t>(_ki_q16) * error;
+    }
+    // Above the usual limit, the limit only follows the integrator back in
+    int64_t shrunk = _integral_limit_q16 < _magnitude(_integral_q16) ? _integral_limit_q16 : _magnitude(_integral_q16);
+    _integral_limit_q16 = shrunk > integral_limit ? shrunk : integral_limit;
+    _integral_q16 = _limit(_integral_q16, _integral_limit_q16);
+    int64_t output = static_cast<int64_t>(_p_term) + (_integral_q16 >> 16) + (_derivative_q16 >> 16);
+    int64_t clamped = output > _high ? _high : output < _low ? _low : output;
+    // Back-calculation: bleed the integrator by the part of the output the clamp removed
+    _integral_q16 = _limit(_integral_q16 + _tracking_q16 * (clamped - output), _integral_limit_q16);
+    return static_cast<int32_t>(clamped);
+}
+
+int32_t FixedPidController::p_term()
+{
+    return _p_term;
+}
+
+int32_t FixedPidController::i_term()
+{
+    return static_cast<int32_t>(_integral_q16 >> 16);
+}
+
+int32_t FixedPidController::d_term()
+{
+    return static_cast<int32_t>(_derivative_q16 >> 16);
+}
@@ -0,0 +1,72 @@
+/**************************************************************************/
+/*
+
+Integer PID controller for the constant-current loop.
+
+The same controller as the double-precision one in STM::_pid_double(), in
+Q16.16: gains are converted once when they are set, the integrator and the
+derivative are kept in Q16 so small gains still accumulate, and every sum
+saturates instead of wrapping.
+
+update() takes the log set point and the log measurement and returns the Z
+offset from mid-scale, already clamped to the output limits:
+
+  - the derivative acts on the measurement, not the error, so a set point
+    change does not kick Z, and is low-pass filtered with a one-pole filter
+  - the integrator is pulled back by tracking * (clamped - unclamped) on
+    every update (back-calculation), so it cannot wind up against the Z
+    limits
+  - engage(output) makes the next update return output exactly, whatever
+    the error, as long as output is within the output limits, by seeding
+    the integrator; gain changes and CCON use it to switch over without a
+    step in Z. A seed beyond FIXED_PID_INTEGRAL_LIMIT is kept: the limit
+    then follows the integrator back in and never grows again
+
+*/
+/**************************************************************************/
+
+#ifndef FIXED_PID_CONTROLLER_H
+#define FIXED_PID_CONTROLLER_H
+
+#include <Arduino.h>
+
+#define FIXED_PID_INTEGRAL_LIMIT 32768   // |iTerm| limit outside an engage, as in the double version
+#define FIXED_PID_DERIVATIVE_LIMIT 65536 // |dTerm| limit, a full Z swing
+
+class FixedPidController
+{
+public:
+    void set_gains(double kp, double ki, double kd);  // Off the hot path
+    void set_filter(double pole, double tracking);     // Derivative pole in [0, 1), back-calculation gain
+    void set_limits(int32_t low, int32_t high);        // Output range, as offsets from mid-scale
+    void engage(int32_t output);                       // Next update returns output
+    int32_t update(int32_t setpoint, int32_t measurement); // pTerm + iTerm + dTerm, clamped
+
+    int32_t p_term();
+    int32_t i_term();
+    int32_t d_term();
+
+    static int32_t saturate(int64_t value); // To the int32 range
+
+private:
+    int32_t _kp_q16 = 0;
+    int32_t _ki_q16 = 0;
+    int32_t _kd_q16 = 0;
+    int32_t _pole_q16 = 0;
+    int32_t _tracking_q16 = 0;
+    int32_t _low = INT32_MIN;
+    int32_t _high = INT32_MAX;
+    int64_t _integral_q16 = 0;
+    int64_t _integral_limit_q16 = static_cast<int64_t>(FIXED_PID_INTEGRAL_LIMIT) << 16;
+    int64_t _derivative_q16 = 0;
+    int32_t _p_term = 0;
+    int32_t _last_measurement = 0;
+    int32_t _engage_output = 0;
+    bool _engage = true;
+
+    static int32_t _to_q16(double gain);
+    static int64_t _limit(int64_t value, int64_t limit);
+    static int64_t _magnitude(int64_t value);
+};
+
+#endif // FIXED_PID_CONTROLLER_H
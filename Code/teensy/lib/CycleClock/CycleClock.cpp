@@ -0,0 +1,56 @@
+/**************************************************************************/
+/*
+CycleClock
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "CycleClock.hpp"
+
+uint32_t CycleClock::_last = 0;
+uint32_t CycleClock::_wraps = 0;
+
+void CycleClock::begin()
+{
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+}
+
+uint64_t CycleClock::now64()
+{
+    uint32_t cycles = ARM_DWT_CYCCNT;
+    if (cycles < _last)
+    {
+        _wraps++;
+    }
+    _last = cycles;
+    return (static_cast<uint64_t>(_wraps) << 32) | cycles;
+}
+
+/**************************************************************************/
+/*
+    A 32-bit stamp taken less than one wrap ago lies exactly
+    (now - stamp) mod 2^32 cycles in the past.
+*/
+/**************************************************************************/
+
+uint64_t CycleClock::extend(uint32_t cycles)
+{
+    uint64_t now = now64();
+    return now - static_cast<uint32_t>(static_cast<uint32_t>(now) - cycles);
+}
+
+uint64_t CycleClock::to_micros(uint64_t cycles)
+{
+    return cycles / (F_CPU_ACTUAL / 1000000);
+}
+
+uint32_t CycleClock::to_nanos(uint32_t cycles)
+{
+    return static_cast<uint32_t>(static_cast<uint64_t>(cycles) * 1000000000ULL / F_CPU_ACTUAL);
+}
+
+uint64_t CycleClock::micros64()
+{
+    return to_micros(now64());
+}
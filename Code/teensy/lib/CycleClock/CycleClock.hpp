@@ -0,0 +1,35 @@
+/**************************************************************************/
+/*
+
+Cycle-accurate timestamps from the DWT cycle counter.
+
+ARM_DWT_CYCCNT runs at the CPU clock and wraps every 2^32 cycles (about
+7.2 s at 600 MHz). Interrupt handlers record the raw 32-bit count; the main
+thread extends it to 64 bits with now64(), which must therefore be called at
+least once per wrap.
+
+*/
+/**************************************************************************/
+
+#ifndef CYCLE_CLOCK_H
+#define CYCLE_CLOCK_H
+
+#include <Arduino.h>
+
+class CycleClock
+{
+public:
+    static void begin();                  // Enable the DWT cycle counter
+    static inline uint32_t now() { return ARM_DWT_CYCCNT; }
+    static uint64_t now64();              // Extended count, main thread only
+    static uint64_t extend(uint32_t cycles); // 64-bit count of a stamp taken within the last wrap
+    static uint64_t to_micros(uint64_t cycles);
+    static uint32_t to_nanos(uint32_t cycles);
+    static uint64_t micros64();           // now64() in microseconds
+
+private:
+    static uint32_t _last;
+    static uint32_t _wraps;
+};
+
+#endif // CYCLE_CLOCK_H
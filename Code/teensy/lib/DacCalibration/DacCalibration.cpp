@@ -0,0 +1,174 @@
+/**************************************************************************/
+/*
+DacCalibration
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include <EEPROM.h>
+#include "DacCalibration.hpp"
+
+/**************************************************************************/
+/*
+    Constructor
+*/
+/**************************************************************************/
+
+DacCalibration::DacCalibration()
+{
+    identity();
+}
+
+void DacCalibration::identity()
+{
+    for (unsigned i = 0; i < DAC_CAL_POINTS; ++i)
+    {
+        _points[i] = static_cast<int32_t>(i * DAC_CAL_STEP);
+    }
+    _identity = true;
+}
+
+bool DacCalibration::is_identity() const
+{
+    return _identity;
+}
+
+int32_t DacCalibration::point(int index) const
+{
+    return _points[index];
+}
+
+uint16_t DacCalibration::breakpoint_code(int index)
+{
+    uint32_t code = index * DAC_CAL_STEP;
+    return code > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(code);
+}
+
+/**************************************************************************/
+/*
+    Interpolation. The segment is code >> 12 and the weight its low 12 bits,
+    so one multiply, one add and one shift per write.
+*/
+/**************************************************************************/
+
+uint16_t DacCalibration::apply(uint16_t code) const
+{
+    if (_identity)
+    {
+        return code;
+    }
+    uint32_t segment = code >> DAC_CAL_SHIFT;
+    int32_t weight = code & (DAC_CAL_STEP - 1);
+    int32_t low = _points[segment];
+    int32_t high = _points[segment + 1];
+    int32_t out = low + (((high - low) * weight + (1 << (DAC_CAL_SHIFT - 1))) >> DAC_CAL_SHIFT);
+    if (out < 0)
+    {
+        return 0;
+    }
+    if (out > 0xFFFF)
+    {
+        return 0xFFFF;
+    }
+    return static_cast<uint16_t>(out);
+}
+
+/**************************************************************************/
+/*
+    Invert the measured transfer curve. For each nominal breakpoint find the
+    segment of the measurement that contains it and interpolate the code
+    inside that segment; beyond the ends the first or last segment is
+    extended. The measurement must rise monotonically.
+*/
+/**************************************************************************/
+
+bool DacCalibration::build(const int32_t *measured)
+{
+    for (unsigned i = 1; i < DAC_CAL_POINTS; ++i)
+    {
+        if (measured[i] <= measured[i - 1])
+        {
+            return false;
+        }
+    }
+    // The top breakpoint was measured at 65535, one code short of the grid
+    int32_t top = measured[DAC_CAL_POINTS - 2] + (measured[DAC_CAL_POINTS - 1] - measured[DAC_CAL_POINTS - 2]) * static_cast<int32_t>(DAC_CAL_STEP) / static_cast<int32_t>(DAC_CAL_STEP - 1);
+    unsigned segment = 0;
+    for (unsigned i = 0; i < DAC_CAL_POINTS; ++i)
+    {
+        int32_t target = static_cast<int32_t>(i * DAC_CAL_STEP);
+        while (segment < DAC_CAL_POINTS - 2 && measured[segment + 1] < target)
+        {
+            segment++;
+        }
+        int32_t code_low = static_cast<int32_t>(segment * DAC_CAL_STEP);
+        int32_t m_low = measured[segment];
+        int32_t m_high = segment + 1 == DAC_CAL_POINTS - 1 ? top : measured[segment + 1];
+        int64_t offset = static_cast<int64_t>(target - m_low) * DAC_CAL_STEP;
+        int32_t span = m_high - m_low;
+        _points[i] = code_low + static_cast<int32_t>((offset + (offset >= 0 ? span / 2 : -span / 2)) / span);
+    }
+    _identity = false;
+    return true;
+}
+
+/**************************************************************************/
+/*
+    EEPROM
+*/
+/**************************************************************************/
+
+uint32_t DacCalibration::_checksum() const
+{
+    uint32_t sum = DAC_CAL_MAGIC;
+    for (unsigned i = 0; i < DAC_CAL_POINTS; ++i)
+    {
+        sum = (sum << 5) + (sum >> 27) + static_cast<uint32_t>(_points[i]);
+    }
+    return sum;
+}
+
+bool DacCalibration::load(int slot)
+{
+    int address = DAC_CAL_EEPROM_BASE + slot * DAC_CAL_EEPROM_STRIDE;
+    uint32_t magic = 0;
+    EEPROM.get(address, magic);
+    if (magic != DAC_CAL_MAGIC)
+    {
+        identity();
+        return false;
+    }
+    address += sizeof(magic);
+    for (unsigned i = 0; i < DAC_CAL_POINTS; ++i)
+    {
+        EEPROM.get(address, _points[i]);
+        address += sizeof(_points[i]);
+    }
+    uint32_t checksum = 0;
+    EEPROM.get(address, checksum);
+    if (checksum != _checksum())
+    {
+        identity();
+        return false;
+    }
+    _identity = false;
+    return true;
+}
+
+void DacCalibration::save(int slot) const
+{
+    int address = DAC_CAL_EEPROM_BASE + slot * DAC_CAL_EEPROM_STRIDE;
+    if (_identity)
+    {
+        EEPROM.put(address, static_cast<uint32_t>(0xFFFFFFFFUL)); // Erased slot
+        return;
+    }
+    EEPROM.put(address, static_cast<uint32_t>(DAC_CAL_MAGIC));
+    address += sizeof(uint32_t);
+    for (unsigned i = 0; i < DAC_CAL_POINTS; ++i)
+    {
+        EEPROM.put(address, _points[i]);
+        address += sizeof(_points[i]);
+    }
+    EEPROM.put(address, _checksum());
+}
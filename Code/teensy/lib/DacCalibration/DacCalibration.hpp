@@ -0,0 +1,55 @@
+/**************************************************************************/
+/*
+
+Piecewise-linear DAC calibration.
+
+The table holds the code to send for each of DAC_CAL_POINTS nominal codes
+spaced DAC_CAL_STEP apart. apply() interpolates between them in integer
+arithmetic, so offset, gain and the bow of the INL curve come out on the
+write path. build() makes the table from a loopback sweep: the output
+measured at each breakpoint, expressed in nominal codes, is inverted so that
+writing nominal code n produces the output the ideal DAC would.
+
+Tables live in the emulated EEPROM, one slot per channel, with a magic
+number and checksum so an erased or stale slot falls back to identity.
+
+*/
+/**************************************************************************/
+
+#ifndef DAC_CALIBRATION_H
+#define DAC_CALIBRATION_H
+
+#include <Arduino.h>
+
+#define DAC_CAL_SHIFT 12
+#define DAC_CAL_STEP (1UL << DAC_CAL_SHIFT)         // Nominal codes between breakpoints
+#define DAC_CAL_POINTS ((65536UL >> DAC_CAL_SHIFT) + 1) // Breakpoints 0, 4096, ... 65536
+#define DAC_CAL_EEPROM_BASE 0
+#define DAC_CAL_EEPROM_STRIDE 80 // Bytes per channel slot
+#define DAC_CAL_MAGIC 0x4C414344UL // "DCAL"
+
+class DacCalibration
+{
+public:
+    DacCalibration(); // Constructor, identity table
+
+    uint16_t apply(uint16_t code) const; // Code to send for a nominal code
+    void identity();
+    bool is_identity() const;
+    int32_t point(int index) const; // Code sent at breakpoint index
+
+    // measured[i] is the output at code breakpoint_code(i), in nominal codes
+    bool build(const int32_t *measured);
+    static uint16_t breakpoint_code(int index); // 65536 is sent as 65535
+
+    bool load(int slot); // False, and identity, when the slot holds no table
+    void save(int slot) const;
+
+private:
+    int32_t _points[DAC_CAL_POINTS]; // Up to 65536 at the top breakpoint
+    bool _identity = true;
+
+    uint32_t _checksum() const;
+};
+
+#endif // DAC_CALIBRATION_H
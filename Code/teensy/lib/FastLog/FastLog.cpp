@@ -0,0 +1,49 @@
+/**************************************************************************/
+/*
+FastLog
+
+Mantissa table generated with:
+
+    C = (2^19-1)*log(2)/log(2^15+1);
+    lut = round(C*log2(1 + (0:256)/256)*2^8);
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "FastLog.hpp"
+
+const uint32_t FastLog::_lut[FAST_LOG_LUT_SIZE + 1] = {
+    0, 50327, 100459, 150397, 200143, 249697, 299063, 348240,
+    397230, 446035, 494656, 543095, 591353, 639431, 687331, 735054,
+    782600, 829973, 877172, 924199, 971056, 1017743, 1064262, 1110613,
+    1156799, 1202821, 1248678, 1294374, 1339908, 1385282, 1430498, 1475555,
+    1520456, 1565201, 1609791, 1654229, 1698513, 1742646, 1786629, 1830463,
+    1874148, 1917686, 1961077, 2004323, 2047425, 2090383, 2133199, 2175873,
+    2218407, 2260801, 2303056, 2345174, 2387154, 2428998, 2470707, 2512282,
+    2553723, 2595032, 2636209, 2677255, 2718171, 2758958, 2799616, 2840146,
+    2880550, 2920827, 2960980, 3001008, 3040912, 3080693, 3120352, 3159889,
+    3199306, 3238602, 3277780, 3316839, 3355780, 3394604, 3433311, 3471903,
+    3510380, 3548742, 3586991, 3625127, 3663150, 3701062, 3738863, 3776553,
+    3814134, 3851606, 3888969, 3926224, 3963372, 4000414, 4037349, 4074179,
+    4110905, 4147526, 4184043, 4220458, 4256770, 4292980, 4329089, 4365098,
+    4401006, 4436814, 4472524, 4508135, 4543648, 4579063, 4614382, 4649604,
+    4684730, 4719761, 4754698, 4789540, 4824288, 4858943, 4893505, 4927975,
+    4962353, 4996640, 5030836, 5064941, 5098957, 5132883, 5166721, 5200470,
+    5234131, 5267704, 5301190, 5334590, 5367903, 5401131, 5434273, 5467331,
+    5500304, 5533193, 5565999, 5598721, 5631360, 5663918, 5696393, 5728787,
+    5761100, 5793332, 5825484, 5857556, 5889548, 5921462, 5953296, 5985053,
+    6016731, 6048332, 6079856, 6111302, 6142673, 6173967, 6205186, 6236330,
+    6267398, 6298392, 6329312, 6360158, 6390930, 6421629, 6452255, 6482809,
+    6513290, 6543700, 6574039, 6604306, 6634502, 6664628, 6694684, 6724670,
+    6754586, 6784434, 6814212, 6843922, 6873564, 6903137, 6932644, 6962083,
+    6991455, 7020760, 7049999, 7079171, 7108278, 7137320, 7166296, 7195208,
+    7224055, 7252837, 7281556, 7310210, 7338802, 7367330, 7395795, 7424197,
+    7452538, 7480816, 7509032, 7537187, 7565280, 7593313, 7621285, 7649196,
+    7677047, 7704838, 7732569, 7760241, 7787854, 7815408, 7842903, 7870340,
+    7897718, 7925039, 7952301, 7979507, 8006655, 8033746, 8060781, 8087759,
+    8114680, 8141546, 8168356, 8195110, 8221809, 8248453, 8275042, 8301576,
+    8328056, 8354482, 8380854, 8407172, 8433436, 8459647, 8485805, 8511910,
+    8537963, 8563963, 8589910, 8615806, 8641650, 8667442, 8693182, 8718872,
+    8744510, 8770098, 8795635, 8821122, 8846558, 8871944, 8897281, 8922568,
+    8947805,
+};
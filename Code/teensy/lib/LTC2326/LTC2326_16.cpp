@@ -8,6 +8,8 @@ LTC2326-16 library for Teensy 4.1
 #include <SPI.h>
 #include "LTC2326_16.hpp"
 
+LTC2326_16 *LTC2326_16::_active = nullptr;
+
 /**************************************************************************/
 /*
     Constructor
@@ -66,6 +68,7 @@ int16_t LTC2326_16::read()
     digitalWrite(_cs, HIGH);
     val = SPI1.transfer16(0x00);
     digitalWrite(_cs, LOW);
+    SPI1.endTransaction();
     return val;
 }
 
@@ -73,4 +76,109 @@ float LTC2326_16::read_volts()
 {
     int16_t val = read();
     return val * _ref_buffer_volts;
+}
+
+/**************************************************************************/
+/*
+    Interrupt-driven reads. BUSY falls when a conversion is complete, so the
+    ISR reads the result right away and callers only look at what it
+    published instead of polling BUSY themselves. read() drops CNV again, so
+    the next convert_isr() call produces a fresh rising edge.
+*/
+/**************************************************************************/
+
+void LTC2326_16::begin_interrupt()
+{
+    _active = this;
+    _interrupt_enabled = true;
+    attachInterrupt(digitalPinToInterrupt(_busy), _busy_isr, FALLING);
+}
+
+void LTC2326_16::end_interrupt()
+{
+    detachInterrupt(digitalPinToInterrupt(_busy));
+    _interrupt_enabled = false;
+    _active = nullptr;
+}
+
+bool LTC2326_16::interrupt_enabled()
+{
+    return _interrupt_enabled;
+}
+
+uint32_t LTC2326_16::sequence()
+{
+    return _seq;
+}
+
+int16_t LTC2326_16::latest(uint32_t &seq)
+{
+    uint32_t cycles;
+    return latest(seq, cycles);
+}
+
+int16_t LTC2326_16::latest(uint32_t &seq, uint32_t &cycles)
+{
+    int16_t val;
+    do
+    {
+        seq = _seq;
+        val = _latest;
+        cycles = _latest_cycles;
+    } while (seq != _seq);
+    return val;
+}
+
+bool LTC2326_16::wait_next(uint32_t &seq, int16_t &value, uint32_t timeout_us)
+{
+    uint32_t cycles;
+    return wait_next(seq, value, cycles, timeout_us);
+}
+
+bool LTC2326_16::wait_next(uint32_t &seq, int16_t &value, uint32_t &cycles, uint32_t timeout_us)
+{
+    uint32_t start_time = micros();
+    uint32_t last_seq = seq;
+    while (_seq == last_seq)
+    {
+        if (micros() - start_time > timeout_us)
+        {
+            value = latest(seq, cycles);
+            return false;
+        }
+    }
+    value = latest(seq, cycles);
+    return true;
+}
+
+void LTC2326_16::_busy_isr()
+{
+    LTC2326_16 *self = _active;
+    if (self == nullptr)
+    {
+        return;
+    }
+    self->_latest = self->read();
+    self->_latest_cycles = self->_cnv_cycles;
+    self->_seq = self->_seq + 1;
+    if (self->_sample_hook != nullptr)
+    {
+        self->_sample_hook(self->_latest);
+    }
+}
+
+void LTC2326_16::set_sample_hook(void (*hook)(int16_t))
+{
+    _sample_hook = hook;
+}
+
+void LTC2326_16::convert_isr()
+{
+    LTC2326_16 *self = _active;
+    if (self == nullptr)
+    {
+        return;
+    }
+    digitalWriteFast(self->_cnv, HIGH);
+    self->_cnv_cycles = CycleClock::now();
 }
\ No newline at end of file
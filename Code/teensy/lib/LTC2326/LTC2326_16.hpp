@@ -36,6 +36,7 @@ http://dberard.com/home-built-stm/
 
 #include <Arduino.h>
 #include <SPI.h> // include the SPI library:
+#include "CycleClock.hpp"
 
 #define ADC_BITS 16
 const int MAX_ADC_OUT = (1 << (ADC_BITS - 1)) - 1; // DAC upper bound
@@ -51,12 +52,35 @@ public:
   int16_t read();                           // Read the ADC data register
   float read_volts();                       // Read the ADC as voltage
 
+  // Interrupt-driven reads: every falling edge of BUSY reads the finished
+  // conversion and publishes it with a sequence number. Conversions are
+  // started elsewhere, normally by convert_isr() on a sample clock.
+  void begin_interrupt();
+  void end_interrupt();
+  bool interrupt_enabled();
+  uint32_t sequence();                      // Number of samples published so far
+  int16_t latest(uint32_t &seq);            // Newest sample and its sequence number
+  int16_t latest(uint32_t &seq, uint32_t &cycles); // ... and the cycle count at its CNV edge
+  bool wait_next(uint32_t &seq, int16_t &value, uint32_t timeout_us); // Wait for a sample newer than seq
+  bool wait_next(uint32_t &seq, int16_t &value, uint32_t &cycles, uint32_t timeout_us);
+  static void convert_isr();                // Start a conversion on the interrupt-driven instance
+  void set_sample_hook(void (*hook)(int16_t)); // Called from the ISR with every sample
+
 private:
   byte _cs;
   byte _cnv;
   byte _busy;
   const SPISettings _spi_settings = SPISettings(40000000, MSBFIRST, SPI_MODE2);
   const float _ref_buffer_volts = 4.096f;
+
+  volatile int16_t _latest = 0;
+  volatile uint32_t _seq = 0;
+  volatile uint32_t _cnv_cycles = 0;
+  volatile uint32_t _latest_cycles = 0;
+  bool _interrupt_enabled = false;
+  void (*_sample_hook)(int16_t) = nullptr;
+  static LTC2326_16 *_active;
+  static void _busy_isr();
 };
 
 #endif // LTC2326_16_h
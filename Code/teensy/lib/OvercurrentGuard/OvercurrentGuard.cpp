@@ -0,0 +1,122 @@
+/**************************************************************************/
+/*
+OvercurrentGuard
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "OvercurrentGuard.hpp"
+
+OvercurrentGuard *OvercurrentGuard::_active = nullptr;
+
+/**************************************************************************/
+/*
+    Constructor
+*/
+/**************************************************************************/
+
+OvercurrentGuard::OvercurrentGuard(AD5761 *dac_z, uint16_t retract_code)
+{
+    _dac_z = dac_z;
+    _retract_code = retract_code;
+}
+
+void OvercurrentGuard::begin()
+{
+    _active = this;
+}
+
+void OvercurrentGuard::arm(int threshold)
+{
+    _threshold = threshold;
+    _armed = threshold > 0;
+}
+
+void OvercurrentGuard::disarm()
+{
+    _armed = false;
+}
+
+bool OvercurrentGuard::armed()
+{
+    return _armed;
+}
+
+int OvercurrentGuard::threshold()
+{
+    return _threshold;
+}
+
+bool OvercurrentGuard::tripped()
+{
+    return _tripped;
+}
+
+void OvercurrentGuard::clear()
+{
+    _tripped = false;
+}
+
+int16_t OvercurrentGuard::trip_value()
+{
+    return _trip_value;
+}
+
+uint32_t OvercurrentGuard::trips()
+{
+    return _trips;
+}
+
+uint16_t OvercurrentGuard::retract_code()
+{
+    return _retract_code;
+}
+
+/**************************************************************************/
+/*
+    Runs in the acquisition interrupt. The Z write shares SPI0 with the main
+    thread, which is safe because the owner registers the acquisition IRQs
+    with SPI.usingInterrupt() and every DAC write is a complete transaction.
+
+    While the fault is latched each sample compares the Z shadow register
+    with the retract code and writes only when they differ. A main-thread Z
+    write that checked the fault just before the trip, and went out just
+    after it, is therefore undone within one sample period instead of
+    leaving the tip forward, without a frame on every sample.
+*/
+/**************************************************************************/
+
+bool OvercurrentGuard::retracted()
+{
+    return _active != nullptr && _active->_tripped;
+}
+
+void OvercurrentGuard::check_isr(int16_t sample)
+{
+    OvercurrentGuard *self = _active;
+    if (self == nullptr)
+    {
+        return;
+    }
+    if (self->_tripped)
+    {
+        uint16_t code = self->_dac_z->calibrate(self->_retract_code);
+        if (!self->_dac_z->shadow_valid() || self->_dac_z->shadow() != code)
+        {
+            self->_dac_z->write_fast(CMD_WR_UPDATE_DAC_REG, code);
+        }
+        return;
+    }
+    if (!self->_armed)
+    {
+        return;
+    }
+    if (abs(sample) < self->_threshold)
+    {
+        return;
+    }
+    self->_dac_z->write_fast(CMD_WR_UPDATE_DAC_REG, self->_dac_z->calibrate(self->_retract_code));
+    self->_trip_value = sample;
+    self->_trips = self->_trips + 1;
+    self->_tripped = true;
+}
@@ -0,0 +1,54 @@
+/**************************************************************************/
+/*
+
+Tip crash protection inside the ADC acquisition interrupt.
+
+check_isr() is installed as the sample hook of the acquisition path and sees
+every conversion. When |current| reaches the threshold it writes the retract
+code to the Z DAC straight away, within the same sample period, and latches
+a fault that stays set until clear() is called. Until then every sample
+checks the Z DAC's shadow register and writes the retract code again if
+anything else has changed it, so no other Z write can stick. The retract
+code is nominal and goes through the DAC's calibration like any other.
+
+*/
+/**************************************************************************/
+
+#ifndef OVERCURRENT_GUARD_H
+#define OVERCURRENT_GUARD_H
+
+#include <Arduino.h>
+#include "AD5761.hpp"
+
+class OvercurrentGuard
+{
+public:
+  OvercurrentGuard(AD5761 *dac_z, uint16_t retract_code); // Constructor
+
+  void begin();               // Make this the guard check_isr() reports to
+  void arm(int threshold);    // Trip when |adc| >= threshold
+  void disarm();
+  bool armed();
+  int threshold();
+  bool tripped();             // Latched until clear()
+  void clear();
+  int16_t trip_value();       // Sample that caused the trip
+  uint32_t trips();           // Trips since power-up
+  uint16_t retract_code();
+
+  static void check_isr(int16_t sample); // Sample hook for the acquisition ISRs
+  static bool retracted();               // Active guard has tripped, safe in an ISR
+
+private:
+  AD5761 *_dac_z;
+  uint16_t _retract_code;
+  volatile int _threshold = 0;
+  volatile bool _armed = false;
+  volatile bool _tripped = false;
+  volatile int16_t _trip_value = 0;
+  volatile uint32_t _trips = 0;
+
+  static OvercurrentGuard *_active;
+};
+
+#endif // OVERCURRENT_GUARD_H
@@ -0,0 +1,184 @@
+/**************************************************************************/
+/*
+PiezoCompensator
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "PiezoCompensator.hpp"
+
+/**************************************************************************/
+/*
+    Constructor
+*/
+/**************************************************************************/
+
+PiezoCompensator::PiezoCompensator()
+{
+    clear();
+}
+
+void PiezoCompensator::clear()
+{
+    _enabled = false;
+    _w0 = 65536;
+    for (int i = 0; i < PIEZO_PLAY_OPERATORS; ++i)
+    {
+        _threshold[i] = 0;
+        _weight[i] = 0;
+        _play[i] = 0;
+    }
+    set_creep(0, 10);
+}
+
+void PiezoCompensator::set_linear_weight(int32_t weight_q16)
+{
+    _w0 = weight_q16;
+}
+
+bool PiezoCompensator::set_operator(int index, uint16_t threshold, int32_t weight_q16)
+{
+    if (index < 0 || index >= PIEZO_PLAY_OPERATORS)
+    {
+        return false;
+    }
+    _threshold[index] = threshold;
+    _weight[index] = threshold == 0 ? 0 : weight_q16;
+    return true;
+}
+
+void PiezoCompensator::set_creep(int32_t gamma_q16, uint32_t tau0_ms)
+{
+    _gamma = gamma_q16;
+    uint32_t tau_us = (tau0_ms > 0 ? tau0_ms : 1) * 1000;
+    for (int k = 0; k < PIEZO_CREEP_LAGS; ++k)
+    {
+        _tau_us[k] = tau_us;
+        tau_us = tau_us <= UINT32_MAX / 10 ? tau_us * 10 : UINT32_MAX;
+    }
+}
+
+/**************************************************************************/
+/*
+    Enabling starts the model at rest on the present code: the play
+    operators centred on it and every lag settled on it. Creep is counted
+    from there, since whatever crept before is already in the position.
+*/
+/**************************************************************************/
+
+void PiezoCompensator::enable(bool on, uint16_t command, uint32_t now_us)
+{
+    _enabled = on;
+    _target = command;
+    _command = command;
+    _last_us = now_us;
+    int32_t x = static_cast<int32_t>(command) - PIEZO_CENTER;
+    for (int i = 0; i < PIEZO_PLAY_OPERATORS; ++i)
+    {
+        _play[i] = x;
+    }
+    _creep_origin = static_cast<int64_t>(command) << 16;
+    for (int k = 0; k < PIEZO_CREEP_LAGS; ++k)
+    {
+        _lag[k] = _creep_origin;
+    }
+}
+
+bool PiezoCompensator::enabled()
+{
+    return _enabled;
+}
+
+uint16_t PiezoCompensator::target()
+{
+    return _target;
+}
+
+uint16_t PiezoCompensator::command()
+{
+    return _command;
+}
+
+int32_t PiezoCompensator::_hysteresis(int32_t x)
+{
+    int64_t sum = static_cast<int64_t>(_w0) * x;
+    for (int i = 0; i < PIEZO_PLAY_OPERATORS; ++i)
+    {
+        if (_threshold[i] == 0)
+        {
+            continue;
+        }
+        int32_t r = _threshold[i];
+        // Play operator: the state follows x only once x is more than r away
+        if (x - r > _play[i])
+        {
+            _play[i] = x - r;
+        }
+        else if (x + r < _play[i])
+        {
+            _play[i] = x + r;
+        }
+        sum += static_cast<int64_t>(_weight[i]) * _play[i];
+    }
+    return static_cast<int32_t>((sum + 32768) >> 16);
+}
+
+/**************************************************************************/
+/*
+    Lag k moves toward the command held over the elapsed time by
+    dt / tau_k, in Q30 and capped at one. A time at or before the last
+    update (the scan tables are precomputed for points still to be played)
+    leaves the lags alone.
+*/
+/**************************************************************************/
+
+void PiezoCompensator::_creep_update(uint32_t now_us)
+{
+    int32_t elapsed_us = static_cast<int32_t>(now_us - _last_us);
+    if (elapsed_us < PIEZO_CREEP_TICK_US)
+    {
+        return;
+    }
+    uint32_t dt_us = static_cast<uint32_t>(elapsed_us);
+    _last_us = now_us;
+    int64_t held = static_cast<int64_t>(_command) << 16;
+    for (int k = 0; k < PIEZO_CREEP_LAGS; ++k)
+    {
+        int64_t alpha = (static_cast<int64_t>(dt_us) << 30) / _tau_us[k];
+        if (alpha > (1LL << 30))
+        {
+            alpha = 1LL << 30;
+        }
+        _lag[k] += ((held - _lag[k]) * alpha) >> 30;
+    }
+}
+
+uint16_t PiezoCompensator::apply(uint16_t target, uint32_t now_us)
+{
+    if (!_enabled)
+    {
+        return target;
+    }
+    _target = target;
+    int32_t command = PIEZO_CENTER + _hysteresis(static_cast<int32_t>(target) - PIEZO_CENTER);
+    if (_gamma != 0)
+    {
+        _creep_update(now_us);
+        int64_t lag_sum = 0;
+        for (int k = 0; k < PIEZO_CREEP_LAGS; ++k)
+        {
+            lag_sum += _lag[k] - _creep_origin;
+        }
+        command -= static_cast<int32_t>((lag_sum * _gamma + (1LL << 31)) >> 32);
+    }
+    if (command < 0)
+    {
+        command = 0;
+    }
+    if (command > 0xFFFF)
+    {
+        command = 0xFFFF;
+    }
+    _command = static_cast<uint16_t>(command);
+    return _command;
+}
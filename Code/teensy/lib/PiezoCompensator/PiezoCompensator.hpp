@@ -0,0 +1,69 @@
+/**************************************************************************/
+/*
+
+Piezo hysteresis and creep compensation for one scan axis.
+
+Hysteresis: the command is a Prandtl-Ishlinskii sum of play operators of
+the target, centred on mid-scale,
+
+    command = center + (w0 * x + sum_i w_i * play_r_i(x)) >> 16,  x = target - center
+
+with the inverse weights and thresholds fitted offline and uploaded.
+
+Creep: logarithmic creep after a step is modelled by first-order lags of
+the command with time constants a decade apart, tau0 .. 1000 * tau0. Each
+lag that catches up adds gamma of the step, which grows with log(t). The
+compensator subtracts gamma * sum_k (lag_k - origin), origin being the code
+it was enabled at, so that the position holds still while the lags settle.
+
+All arithmetic is integer: weights and gamma in Q16, lag states in Q16
+codes.
+
+*/
+/**************************************************************************/
+
+#ifndef PIEZO_COMPENSATOR_H
+#define PIEZO_COMPENSATOR_H
+
+#include <Arduino.h>
+
+#define PIEZO_PLAY_OPERATORS 8
+#define PIEZO_CREEP_LAGS 4
+#define PIEZO_CENTER 32768
+#define PIEZO_CREEP_TICK_US 1000 // Shortest interval between creep updates
+
+class PiezoCompensator
+{
+public:
+    PiezoCompensator(); // Constructor, identity model, disabled
+
+    void clear();                                                  // Identity model, disabled
+    void set_linear_weight(int32_t weight_q16);                    // w0, 65536 is unity
+    bool set_operator(int index, uint16_t threshold, int32_t weight_q16); // threshold 0 removes it
+    void set_creep(int32_t gamma_q16, uint32_t tau0_ms);           // gamma per lag, 0 disables creep
+    void enable(bool on, uint16_t command, uint32_t now_us);       // Starts at rest at command
+    bool enabled();
+
+    uint16_t apply(uint16_t target, uint32_t now_us); // Command code for a target code
+    uint16_t target();
+    uint16_t command();
+
+private:
+    int32_t _w0 = 65536;
+    uint16_t _threshold[PIEZO_PLAY_OPERATORS];
+    int32_t _weight[PIEZO_PLAY_OPERATORS];
+    int32_t _play[PIEZO_PLAY_OPERATORS]; // Operator states, codes from center
+    int32_t _gamma = 0;
+    uint32_t _tau_us[PIEZO_CREEP_LAGS];
+    int64_t _lag[PIEZO_CREEP_LAGS]; // Q16 codes
+    int64_t _creep_origin = 0;      // Q16 code the model was enabled at
+    uint32_t _last_us = 0;
+    uint16_t _target = PIEZO_CENTER;
+    uint16_t _command = PIEZO_CENTER;
+    bool _enabled = false;
+
+    int32_t _hysteresis(int32_t x);
+    void _creep_update(uint32_t now_us);
+};
+
+#endif // PIEZO_COMPENSATOR_H
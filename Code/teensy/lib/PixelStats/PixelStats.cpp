@@ -0,0 +1,102 @@
+/**************************************************************************/
+/*
+PixelStats
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "PixelStats.hpp"
+
+/**************************************************************************/
+/*
+    Constructor
+*/
+/**************************************************************************/
+
+PixelStats::PixelStats()
+{
+    reset();
+}
+
+void PixelStats::reset()
+{
+    _count = 0;
+    _offset = 0;
+    _sum = 0;
+    _sum_sq = 0;
+    _min = 0;
+    _max = 0;
+}
+
+void PixelStats::add(int32_t sample)
+{
+    if (_count == 0)
+    {
+        _offset = sample;
+        _min = sample;
+        _max = sample;
+    }
+    int64_t d = sample - _offset;
+    _sum += d;
+    _sum_sq += static_cast<uint64_t>(d * d);
+    if (sample < _min)
+    {
+        _min = sample;
+    }
+    if (sample > _max)
+    {
+        _max = sample;
+    }
+    _count++;
+}
+
+uint32_t PixelStats::count()
+{
+    return _count;
+}
+
+int32_t PixelStats::mean()
+{
+    if (_count == 0)
+    {
+        return 0;
+    }
+    int64_t n = _count;
+    int64_t rounded = _sum >= 0 ? (_sum + n / 2) / n : (_sum - n / 2) / n;
+    return _offset + static_cast<int32_t>(rounded);
+}
+
+/**************************************************************************/
+/*
+    var = (sum_sq - sum^2 / n) / n. With |sum| < 2^32 and n < 2^16 the
+    square needs 64 bits before the division, so sum^2 / n is formed from
+    sum = q * n + r as sum * q + sum * r / n; both products stay below 2^48.
+*/
+/**************************************************************************/
+
+int32_t PixelStats::variance()
+{
+    if (_count < 2)
+    {
+        return 0;
+    }
+    uint64_t n = _count;
+    uint64_t a = static_cast<uint64_t>(_sum >= 0 ? _sum : -_sum);
+    uint64_t square_over_n = a * (a / n) + (a * (a % n)) / n;
+    if (square_over_n >= _sum_sq)
+    {
+        return 0;
+    }
+    uint64_t var = (_sum_sq - square_over_n) / n;
+    return var > INT32_MAX ? INT32_MAX : static_cast<int32_t>(var);
+}
+
+int32_t PixelStats::min()
+{
+    return _min;
+}
+
+int32_t PixelStats::max()
+{
+    return _max;
+}
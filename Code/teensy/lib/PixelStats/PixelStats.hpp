@@ -0,0 +1,45 @@
+/**************************************************************************/
+/*
+
+One-pass statistics of the samples that make up a scan pixel.
+
+add() keeps integer sums of the samples and of their squares, taken relative
+to the first sample so the sums stay small, plus the running min and max.
+Mean and variance are formed once per pixel, the mean as a plain integer
+rounded to the nearest count. The sums and the variance are exact for up
+to PIXEL_STATS_MAX_SAMPLES samples of 16-bit data; the caller keeps a
+pixel within that.
+
+*/
+/**************************************************************************/
+
+#ifndef PIXEL_STATS_H
+#define PIXEL_STATS_H
+
+#include <Arduino.h>
+
+#define PIXEL_STATS_MAX_SAMPLES 65535
+
+class PixelStats
+{
+public:
+    PixelStats(); // Constructor
+
+    void reset();
+    void add(int32_t sample);
+    uint32_t count();
+    int32_t mean();     // Rounded to the nearest count
+    int32_t variance(); // Population variance in counts^2
+    int32_t min();
+    int32_t max();
+
+private:
+    uint32_t _count;
+    int32_t _offset; // First sample of the pixel
+    int64_t _sum;    // Sum of (sample - offset)
+    uint64_t _sum_sq; // Sum of (sample - offset)^2
+    int32_t _min;
+    int32_t _max;
+};
+
+#endif // PIXEL_STATS_H
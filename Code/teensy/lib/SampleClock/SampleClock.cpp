@@ -0,0 +1,99 @@
+/**************************************************************************/
+/*
+SampleClock
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "SampleClock.hpp"
+
+SampleClock *SampleClock::_active = nullptr;
+
+/**************************************************************************/
+/*
+    Start the clock. GPT1 counts the 24 MHz crystal in restart mode, so the
+    period has a resolution of one 24 MHz tick, as the PIT had.
+*/
+/**************************************************************************/
+
+bool SampleClock::begin(void (*handler)(), uint32_t rate_hz)
+{
+    end();
+    _handler = handler;
+    _rate_hz = clamp_rate(rate_hz);
+    _active = this;
+    CCM_CCGR1 |= CCM_CCGR1_GPT_BUS(CCM_CCGR_ON) | CCM_CCGR1_GPT_SERIAL(CCM_CCGR_ON);
+    GPT1_CR = 0;
+    GPT1_PR = 0;
+    GPT1_SR = 0x3F;
+    GPT1_IR = GPT_IR_OF1IE;
+    GPT1_CR = GPT_CR_EN_24M | GPT_CR_CLKSRC(5);
+    GPT1_OCR1 = _period_ticks() - 1;
+    attachInterruptVector(IRQ_GPT1, _isr);
+    NVIC_SET_PRIORITY(IRQ_GPT1, SAMPLE_CLOCK_PRIORITY);
+    NVIC_ENABLE_IRQ(IRQ_GPT1);
+    GPT1_CR |= GPT_CR_ENMOD | GPT_CR_EN;
+    _running = true;
+    return _running;
+}
+
+void SampleClock::end()
+{
+    if (_running)
+    {
+        NVIC_DISABLE_IRQ(IRQ_GPT1);
+        GPT1_CR = 0;
+        GPT1_SR = 0x3F;
+    }
+    _running = false;
+}
+
+bool SampleClock::set_rate(uint32_t rate_hz)
+{
+    _rate_hz = clamp_rate(rate_hz);
+    if (_running)
+    {
+        GPT1_OCR1 = _period_ticks() - 1; // Restarts the count
+    }
+    return _rate_hz == rate_hz;
+}
+
+uint32_t SampleClock::rate_hz()
+{
+    return _rate_hz;
+}
+
+uint32_t SampleClock::period_ns()
+{
+    return 1000000000UL / _rate_hz;
+}
+
+bool SampleClock::running()
+{
+    return _running;
+}
+
+uint32_t SampleClock::clamp_rate(uint32_t rate_hz)
+{
+    if (rate_hz < SAMPLE_CLOCK_MIN_HZ)
+    {
+        return SAMPLE_CLOCK_MIN_HZ;
+    }
+    if (rate_hz > SAMPLE_CLOCK_MAX_HZ)
+    {
+        return SAMPLE_CLOCK_MAX_HZ;
+    }
+    return rate_hz;
+}
+
+uint32_t SampleClock::_period_ticks()
+{
+    return (SAMPLE_CLOCK_TICK_HZ + _rate_hz / 2) / _rate_hz;
+}
+
+void SampleClock::_isr()
+{
+    GPT1_SR = GPT_SR_OF1;
+    _active->_handler();
+    asm volatile("dsb"); // Let the flag clear before the handler returns
+}
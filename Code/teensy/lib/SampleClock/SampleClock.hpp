@@ -0,0 +1,54 @@
+/**************************************************************************/
+/*
+
+Hardware-timer sample clock.
+
+GPT1 calls one handler per sample period. The ADC conversions are started
+from that handler, so the physical sampling rate is known and does not
+depend on how long the main loop takes.
+
+The clock deliberately does not use the PIT. All PIT channels share one
+interrupt, and the feedback loop and the waveform player register that
+interrupt with SPI.usingInterrupt() because they write the DACs. A PIT
+sample clock would then be held off by every main-thread DAC transaction
+and by the run time of those handlers. GPT1 has its own vector, is never
+registered with SPI, and runs at a higher NVIC priority than the PIT and
+the acquisition interrupts, so the conversion edge keeps to the clock.
+
+*/
+/**************************************************************************/
+
+#ifndef SAMPLE_CLOCK_H
+#define SAMPLE_CLOCK_H
+
+#include <Arduino.h>
+
+#define SAMPLE_CLOCK_MIN_HZ 10000      // Slowest programmable rate
+#define SAMPLE_CLOCK_MAX_HZ 250000     // LTC2326-16 throughput limit
+#define SAMPLE_CLOCK_DEFAULT_HZ 100000 // Rate after reset
+#define SAMPLE_CLOCK_TICK_HZ 24000000  // GPT1 on the 24 MHz crystal
+#define SAMPLE_CLOCK_PRIORITY 32       // NVIC priority, above the default 128 of the PIT and GPIO
+
+class SampleClock
+{
+public:
+    bool begin(void (*handler)(), uint32_t rate_hz); // Start calling handler at rate_hz
+    void end();
+    bool set_rate(uint32_t rate_hz); // Change the rate without stopping the clock
+    uint32_t rate_hz();              // Rate actually programmed, after clamping
+    uint32_t period_ns();
+    bool running();
+
+    static uint32_t clamp_rate(uint32_t rate_hz);
+
+private:
+    void (*_handler)() = nullptr;
+    uint32_t _rate_hz = SAMPLE_CLOCK_DEFAULT_HZ;
+    bool _running = false;
+
+    uint32_t _period_ticks();
+    static SampleClock *_active;
+    static void _isr();
+};
+
+#endif // SAMPLE_CLOCK_H
@@ -0,0 +1,136 @@
+/**************************************************************************/
+/*
+SigmaDeltaDac
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "SigmaDeltaDac.hpp"
+
+SigmaDeltaDac *SigmaDeltaDac::_registered[SIGMA_DELTA_MAX_DACS];
+int SigmaDeltaDac::_count = 0;
+volatile bool SigmaDeltaDac::_suspended = false;
+
+/**************************************************************************/
+/*
+    Constructor
+*/
+/**************************************************************************/
+
+SigmaDeltaDac::SigmaDeltaDac(AD5761 *dac)
+{
+    _dac = dac;
+}
+
+void SigmaDeltaDac::begin()
+{
+    for (int i = 0; i < _count; ++i)
+    {
+        if (_registered[i] == this)
+        {
+            return;
+        }
+    }
+    if (_count < SIGMA_DELTA_MAX_DACS)
+    {
+        _registered[_count] = this;
+        _count++;
+    }
+}
+
+/**************************************************************************/
+/*
+    The modulator is disabled while its state changes, so a sample interrupt
+    in between sees either the old target or nothing.
+*/
+/**************************************************************************/
+
+void SigmaDeltaDac::set(uint32_t position)
+{
+    if (position > SIGMA_DELTA_MAX_POSITION)
+    {
+        position = SIGMA_DELTA_MAX_POSITION;
+    }
+    _enabled = false;
+    _position = position;
+    _integer = static_cast<uint16_t>(position >> SIGMA_DELTA_FRACTION_BITS);
+    _fraction = position & SIGMA_DELTA_FRACTION_MASK;
+    _accumulator = 0;
+    _dac->write_code(_integer);
+    _written = _integer;
+    _enabled = _fraction != 0;
+}
+
+void SigmaDeltaDac::release()
+{
+    _enabled = false;
+}
+
+void SigmaDeltaDac::set_inhibit(bool (*inhibit)())
+{
+    _inhibit = inhibit;
+}
+
+uint32_t SigmaDeltaDac::position()
+{
+    return _position;
+}
+
+uint16_t SigmaDeltaDac::code()
+{
+    return _integer;
+}
+
+bool SigmaDeltaDac::dithering()
+{
+    return _enabled;
+}
+
+/**************************************************************************/
+/*
+    One modulator step. The accumulator carries the fraction over from step
+    to step; each carry out puts the DAC one LSB higher for one period.
+*/
+/**************************************************************************/
+
+void SigmaDeltaDac::step_isr()
+{
+    if (!_enabled)
+    {
+        return;
+    }
+    if (_inhibit != nullptr && _inhibit())
+    {
+        _enabled = false;
+        return;
+    }
+    _accumulator += _fraction;
+    uint32_t code = _integer + (_accumulator >> SIGMA_DELTA_FRACTION_BITS);
+    _accumulator &= SIGMA_DELTA_FRACTION_MASK;
+    if (code > 0xFFFF)
+    {
+        code = 0xFFFF;
+    }
+    if (code != _written)
+    {
+        _dac->write_fast(CMD_WR_UPDATE_DAC_REG, _dac->calibrate(code));
+        _written = static_cast<uint16_t>(code);
+    }
+}
+
+void SigmaDeltaDac::suspend_all(bool suspended)
+{
+    _suspended = suspended;
+}
+
+void SigmaDeltaDac::step_all_isr()
+{
+    if (_suspended)
+    {
+        return;
+    }
+    for (int i = 0; i < _count; ++i)
+    {
+        _registered[i]->step_isr();
+    }
+}
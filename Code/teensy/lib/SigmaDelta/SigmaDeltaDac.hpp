@@ -0,0 +1,59 @@
+/**************************************************************************/
+/*
+
+Sub-LSB DAC positioning by first-order sigma-delta modulation.
+
+A position carries SIGMA_DELTA_FRACTION_BITS more bits than the DAC. The
+integer part is written straight away; the fraction is produced by toggling
+the DAC between code and code + 1 so that the mean output equals the target.
+step_isr() runs one modulator step. It is called from the ADC sample hook,
+so the dither runs at the sample clock rate and averages out in the same
+filters that average the ADC.
+
+*/
+/**************************************************************************/
+
+#ifndef SIGMA_DELTA_DAC_H
+#define SIGMA_DELTA_DAC_H
+
+#include <Arduino.h>
+#include "AD5761.hpp"
+
+#define SIGMA_DELTA_FRACTION_BITS 4 // 20-bit positions on a 16-bit DAC
+#define SIGMA_DELTA_FRACTION_MASK ((1UL << SIGMA_DELTA_FRACTION_BITS) - 1)
+#define SIGMA_DELTA_MAX_POSITION ((1UL << (16 + SIGMA_DELTA_FRACTION_BITS)) - 1)
+#define SIGMA_DELTA_MAX_DACS 4
+
+class SigmaDeltaDac
+{
+public:
+  SigmaDeltaDac(AD5761 *dac); // Constructor
+
+  void begin();                      // Join the set stepped by step_all_isr()
+  void set(uint32_t position);       // Main thread, clamped to SIGMA_DELTA_MAX_POSITION
+  void release();                    // Stop dithering before a direct DAC write
+  void set_inhibit(bool (*inhibit)()); // Dithering stops for good while this returns true
+  uint32_t position();               // Last target
+  uint16_t code();                   // Integer part of the last target
+  bool dithering();
+
+  void step_isr();
+  static void step_all_isr(); // One step of every registered modulator
+  static void suspend_all(bool suspended); // While suspended no step runs and the outputs hold their last code
+
+private:
+  AD5761 *_dac;
+  bool (*_inhibit)() = nullptr;
+  uint32_t _position = 0;
+  uint16_t _integer = 0;
+  uint32_t _fraction = 0;
+  uint32_t _accumulator = 0;
+  uint16_t _written = 0; // Code the modulator wrote last
+  volatile bool _enabled = false;
+
+  static SigmaDeltaDac *_registered[SIGMA_DELTA_MAX_DACS];
+  static int _count;
+  static volatile bool _suspended;
+};
+
+#endif // SIGMA_DELTA_DAC_H
@@ -0,0 +1,139 @@
+/**************************************************************************/
+/*
+NoiseSpectrum
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "NoiseSpectrum.hpp"
+
+/**************************************************************************/
+/*
+    Constructor. The tables are the only place that uses floating point.
+*/
+/**************************************************************************/
+
+NoiseSpectrum::NoiseSpectrum()
+{
+    for (int k = 0; k < NOISE_FFT_SIZE / 2; ++k)
+    {
+        float phase = 2.0f * (float)M_PI * k / NOISE_FFT_SIZE;
+        _cos[k] = static_cast<int16_t>(lroundf(cosf(phase) * 32767.0f));
+        _sin[k] = static_cast<int16_t>(lroundf(sinf(phase) * 32767.0f));
+    }
+    for (int i = 0; i < NOISE_FFT_SIZE; ++i)
+    {
+        float phase = 2.0f * (float)M_PI * i / NOISE_FFT_SIZE;
+        _window[i] = static_cast<int16_t>(lroundf(0.5f * (1.0f - cosf(phase)) * 32767.0f));
+        uint16_t reversed = 0;
+        for (int b = 0; b < NOISE_FFT_LOG2_SIZE; ++b)
+        {
+            if (i & (1 << b))
+            {
+                reversed |= 1 << (NOISE_FFT_LOG2_SIZE - 1 - b);
+            }
+        }
+        _bit_reverse[i] = reversed;
+    }
+    reset();
+}
+
+void NoiseSpectrum::reset()
+{
+    for (int k = 0; k < NOISE_FFT_BINS; ++k)
+    {
+        _power[k] = 0;
+    }
+    _blocks = 0;
+}
+
+uint32_t NoiseSpectrum::blocks()
+{
+    return _blocks;
+}
+
+uint64_t NoiseSpectrum::bin(int k)
+{
+    if (_blocks == 0)
+    {
+        return 0;
+    }
+    return _power[k] / _blocks;
+}
+
+uint32_t NoiseSpectrum::window_power()
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < NOISE_FFT_SIZE; ++i)
+    {
+        sum += static_cast<int32_t>(_window[i]) * _window[i];
+    }
+    return static_cast<uint32_t>(sum >> 15);
+}
+
+/**************************************************************************/
+/*
+    Add one block. After transform() the bins hold X_k * 2^12 / N, so
+    |X_k|^2 = |bin|^2 * 2^(2 * (log2 N - 12)). A centred sample spans 17
+    bits, up to +-65535, so the shifted inputs stay below 2^28.
+*/
+/**************************************************************************/
+
+void NoiseSpectrum::add_block(const int16_t *samples)
+{
+    int32_t sum = 0;
+    for (int i = 0; i < NOISE_FFT_SIZE; ++i)
+    {
+        sum += samples[i];
+    }
+    int32_t mean = sum >> NOISE_FFT_LOG2_SIZE;
+    for (int i = 0; i < NOISE_FFT_SIZE; ++i)
+    {
+        int32_t centered = samples[i] - mean;
+        _re[_bit_reverse[i]] = ((centered * _window[i]) >> 15) * (1 << NOISE_FFT_INPUT_SHIFT);
+        _im[_bit_reverse[i]] = 0;
+    }
+    transform(_re, _im);
+    const int shift = 2 * (NOISE_FFT_LOG2_SIZE - NOISE_FFT_INPUT_SHIFT);
+    for (int k = 0; k < NOISE_FFT_BINS; ++k)
+    {
+        int64_t re = _re[k];
+        int64_t im = _im[k];
+        uint64_t power = static_cast<uint64_t>(re * re + im * im);
+        _power[k] += shift >= 0 ? power << shift : power >> -shift;
+    }
+    _blocks++;
+}
+
+/**************************************************************************/
+/*
+    Radix-2 decimation-in-time butterflies on bit-reversed input. Every
+    stage halves its outputs, so with inputs below 2^28 in magnitude no
+    butterfly sum reaches 2^29, well inside int32.
+*/
+/**************************************************************************/
+
+void NoiseSpectrum::transform(int32_t *re, int32_t *im)
+{
+    for (int size = 2; size <= NOISE_FFT_SIZE; size <<= 1)
+    {
+        int half = size >> 1;
+        int step = NOISE_FFT_SIZE / size;
+        for (int start = 0; start < NOISE_FFT_SIZE; start += size)
+        {
+            for (int j = 0; j < half; ++j)
+            {
+                int32_t wr = _cos[j * step];
+                int32_t wi = -_sin[j * step];
+                int a = start + j;
+                int b = a + half;
+                int32_t tr = static_cast<int32_t>((static_cast<int64_t>(re[b]) * wr - static_cast<int64_t>(im[b]) * wi) >> 15);
+                int32_t ti = static_cast<int32_t>((static_cast<int64_t>(re[b]) * wi + static_cast<int64_t>(im[b]) * wr) >> 15);
+                re[b] = (re[a] - tr) >> 1;
+                im[b] = (im[a] - ti) >> 1;
+                re[a] = (re[a] + tr) >> 1;
+                im[a] = (im[a] + ti) >> 1;
+            }
+        }
+    }
+}
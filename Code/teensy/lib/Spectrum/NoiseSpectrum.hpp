@@ -0,0 +1,52 @@
+/**************************************************************************/
+/*
+
+Averaged power spectrum of ADC blocks, computed on the Teensy.
+
+Each block of NOISE_FFT_SIZE samples has its mean removed, is multiplied by
+a Hann window and goes through a fixed-point radix-2 FFT. The squared
+magnitudes are averaged over blocks (Welch's method with 50% overlap when
+the caller feeds overlapping blocks).
+
+The bins are mean |X_k|^2 of the unscaled DFT in ADC counts^2. The one-sided
+power spectral density in counts^2/Hz is 2 * bin / (fs * S2), with
+S2 = sum(w^2) = window_power() / 2^15.
+
+*/
+/**************************************************************************/
+
+#ifndef NOISE_SPECTRUM_H
+#define NOISE_SPECTRUM_H
+
+#include <Arduino.h>
+
+#define NOISE_FFT_LOG2_SIZE 10
+#define NOISE_FFT_SIZE (1 << NOISE_FFT_LOG2_SIZE)
+#define NOISE_FFT_BINS (NOISE_FFT_SIZE / 2 + 1)
+#define NOISE_FFT_INPUT_SHIFT 12 // Centred samples (|x| < 2^16) become FFT inputs below 2^28
+
+class NoiseSpectrum
+{
+public:
+  NoiseSpectrum(); // Constructor, builds the twiddle and window tables
+
+  void reset();
+  void add_block(const int16_t *samples); // NOISE_FFT_SIZE samples
+  uint32_t blocks();
+  uint64_t bin(int k);         // Mean |X_k|^2 over the blocks added so far
+  uint32_t window_power();     // sum(w^2) in Q15
+
+  void transform(int32_t *re, int32_t *im); // In-place FFT, scaled by 1 / NOISE_FFT_SIZE
+
+private:
+  int16_t _cos[NOISE_FFT_SIZE / 2]; // Q15
+  int16_t _sin[NOISE_FFT_SIZE / 2]; // Q15
+  int16_t _window[NOISE_FFT_SIZE];  // Hann, Q15
+  uint16_t _bit_reverse[NOISE_FFT_SIZE];
+  int32_t _re[NOISE_FFT_SIZE];
+  int32_t _im[NOISE_FFT_SIZE];
+  uint64_t _power[NOISE_FFT_BINS];
+  uint32_t _blocks = 0;
+};
+
+#endif // NOISE_SPECTRUM_H
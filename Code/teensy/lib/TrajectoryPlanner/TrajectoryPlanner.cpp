@@ -0,0 +1,108 @@
+/**************************************************************************/
+/*
+TrajectoryPlanner
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "TrajectoryPlanner.hpp"
+
+void TrajectoryPlanner::configure(uint32_t max_rate, uint32_t max_accel)
+{
+    if (max_rate > 0)
+    {
+        _max_rate = max(max_rate, static_cast<uint32_t>(TRAJECTORY_MIN_RATE));
+    }
+    if (max_accel > 0)
+    {
+        _max_accel = max_accel;
+    }
+}
+
+uint32_t TrajectoryPlanner::max_rate()
+{
+    return _max_rate;
+}
+
+uint32_t TrajectoryPlanner::max_accel()
+{
+    return _max_accel;
+}
+
+/**************************************************************************/
+/*
+    Plan a move. With v the slew limit and a the acceleration limit, a move
+    longer than v^2 / a accelerates for v / a, cruises, then decelerates;
+    a shorter one peaks at sqrt(a * d) halfway.
+*/
+/**************************************************************************/
+
+uint32_t TrajectoryPlanner::plan(int x_start, int y_start, int x_end, int y_end)
+{
+    _x_start = x_start;
+    _y_start = y_start;
+    _dx = x_end - x_start;
+    _dy = y_end - y_start;
+    _distance = static_cast<float>(max(abs(_dx), abs(_dy)));
+
+    float v = static_cast<float>(_max_rate);
+    float a = static_cast<float>(_max_accel);
+    if (_distance * a >= v * v)
+    {
+        _peak_rate = v;
+        _t_accel = v / a;
+        _t_total = 2 * _t_accel + (_distance - v * v / a) / v;
+    }
+    else
+    {
+        _t_accel = sqrtf(_distance / a);
+        _peak_rate = a * _t_accel;
+        _t_total = 2 * _t_accel;
+    }
+    _duration_us = static_cast<uint32_t>(ceilf(_t_total * 1e6f));
+    return _duration_us;
+}
+
+uint32_t TrajectoryPlanner::duration_us()
+{
+    return _duration_us;
+}
+
+float TrajectoryPlanner::_distance_at(float t)
+{
+    float a = static_cast<float>(_max_accel);
+    if (t <= 0)
+    {
+        return 0;
+    }
+    if (t >= _t_total)
+    {
+        return _distance;
+    }
+    if (t < _t_accel)
+    {
+        return 0.5f * a * t * t;
+    }
+    float t_decel = _t_total - _t_accel;
+    float d_accel = 0.5f * a * _t_accel * _t_accel;
+    if (t < t_decel)
+    {
+        return d_accel + _peak_rate * (t - _t_accel);
+    }
+    float t_left = _t_total - t;
+    return _distance - 0.5f * a * t_left * t_left;
+}
+
+bool TrajectoryPlanner::position_at(uint32_t elapsed_us, int &x, int &y)
+{
+    if (_distance == 0 || elapsed_us >= _duration_us)
+    {
+        x = _x_start + _dx;
+        y = _y_start + _dy;
+        return false;
+    }
+    float fraction = _distance_at(elapsed_us * 1e-6f) / _distance;
+    x = _x_start + static_cast<int>(lroundf(fraction * _dx));
+    y = _y_start + static_cast<int>(lroundf(fraction * _dy));
+    return true;
+}
@@ -0,0 +1,51 @@
+/**************************************************************************/
+/*
+
+Straight-line X/Y moves with a trapezoidal speed profile.
+
+Both axes travel together and arrive together. The longer axis runs at no
+more than the maximum slew rate and acceleration; the shorter one is scaled
+down with it. Moves too short to reach full speed get a triangular profile.
+The caller asks for the position at the time of each ADC sample, so the
+move is paced by the sample clock rather than by the loop.
+
+*/
+/**************************************************************************/
+
+#ifndef TRAJECTORY_PLANNER_H
+#define TRAJECTORY_PLANNER_H
+
+#include <Arduino.h>
+
+#define TRAJECTORY_DEFAULT_RATE 20000   // codes/s
+#define TRAJECTORY_DEFAULT_ACCEL 200000 // codes/s^2
+#define TRAJECTORY_MIN_RATE 100         // codes/s, a full-range move then fits easily in uint32 us
+
+class TrajectoryPlanner
+{
+public:
+    void configure(uint32_t max_rate, uint32_t max_accel); // codes/s and codes/s^2, 0 keeps the current value
+    uint32_t max_rate();
+    uint32_t max_accel();
+
+    uint32_t plan(int x_start, int y_start, int x_end, int y_end); // Returns the duration in us
+    uint32_t duration_us();
+    bool position_at(uint32_t elapsed_us, int &x, int &y); // False once the move has ended
+
+private:
+    uint32_t _max_rate = TRAJECTORY_DEFAULT_RATE;
+    uint32_t _max_accel = TRAJECTORY_DEFAULT_ACCEL;
+    int _x_start = 0;
+    int _y_start = 0;
+    int _dx = 0;
+    int _dy = 0;
+    float _distance = 0; // Along the longer axis, in codes
+    float _t_accel = 0;  // Seconds spent accelerating, and again decelerating
+    float _t_total = 0;
+    float _peak_rate = 0;
+    uint32_t _duration_us = 0;
+
+    float _distance_at(float t); // Codes covered after t seconds
+};
+
+#endif // TRAJECTORY_PLANNER_H
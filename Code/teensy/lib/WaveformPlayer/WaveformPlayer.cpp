@@ -0,0 +1,208 @@
+/**************************************************************************/
+/*
+WaveformPlayer
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "WaveformPlayer.hpp"
+
+WaveformPlayer *WaveformPlayer::_active = nullptr;
+
+/**************************************************************************/
+/*
+    Constructor
+*/
+/**************************************************************************/
+
+WaveformPlayer::WaveformPlayer(AD5761 *dac_x, AD5761 *dac_y)
+{
+    _dac_x = dac_x;
+    _dac_y = dac_y;
+}
+
+void WaveformPlayer::clear()
+{
+    end();
+    _length = 0;
+}
+
+bool WaveformPlayer::append(int x, int y)
+{
+    if (_running || _length >= WAVEFORM_MAX_POINTS)
+    {
+        return false;
+    }
+    _table[_length].x = static_cast<uint16_t>(x);
+    _table[_length].y = static_cast<uint16_t>(y);
+    _length++;
+    return true;
+}
+
+uint32_t WaveformPlayer::length()
+{
+    return _length;
+}
+
+/**************************************************************************/
+/*
+    Start playback. x_now and y_now are the codes the DACs already hold, so
+    the first point only writes the axes that move.
+*/
+/**************************************************************************/
+
+bool WaveformPlayer::begin(uint32_t rate_hz, uint32_t repeats, int x_now, int y_now)
+{
+    end();
+    if (_length == 0)
+    {
+        return false;
+    }
+    _rate_hz = clamp_rate(rate_hz);
+    _total = repeats * _length;
+    _position = 0;
+    _paused = false;
+    _x = x_now;
+    _y = y_now;
+    _active = this;
+    _running = true;
+    if (!_timer.begin(_isr, 1000000.0f / _rate_hz))
+    {
+        _running = false;
+        _active = nullptr;
+    }
+    return _running;
+}
+
+void WaveformPlayer::end()
+{
+    _timer.end();
+    _running = false;
+    _paused = false;
+    _active = nullptr;
+}
+
+/**************************************************************************/
+/*
+    Pause and resume, for work that needs the DACs left alone for a while.
+    The outputs hold the last point written.
+*/
+/**************************************************************************/
+
+bool WaveformPlayer::pause()
+{
+    if (!_running)
+    {
+        return false;
+    }
+    _timer.end();
+    _running = false;
+    _paused = true;
+    return true;
+}
+
+bool WaveformPlayer::resume()
+{
+    if (!_paused)
+    {
+        return false;
+    }
+    _paused = false;
+    _running = true;
+    if (!_timer.begin(_isr, 1000000.0f / _rate_hz))
+    {
+        _running = false;
+        _active = nullptr;
+    }
+    return _running;
+}
+
+bool WaveformPlayer::running()
+{
+    return _running;
+}
+
+uint32_t WaveformPlayer::rate_hz()
+{
+    return _rate_hz;
+}
+
+uint32_t WaveformPlayer::position()
+{
+    return _position;
+}
+
+uint32_t WaveformPlayer::point_cycles()
+{
+    return _point_cycles;
+}
+
+int WaveformPlayer::x()
+{
+    return _x;
+}
+
+int WaveformPlayer::y()
+{
+    return _y;
+}
+
+uint32_t WaveformPlayer::clamp_rate(uint32_t rate_hz)
+{
+    if (rate_hz < WAVEFORM_MIN_HZ)
+    {
+        return WAVEFORM_MIN_HZ;
+    }
+    if (rate_hz > WAVEFORM_MAX_HZ)
+    {
+        return WAVEFORM_MAX_HZ;
+    }
+    return rate_hz;
+}
+
+/**************************************************************************/
+/*
+    Timer interrupt, one table point per call. SPI.usingInterrupt(IRQ_PIT)
+    keeps main-thread DAC transactions from being cut in half.
+*/
+/**************************************************************************/
+
+void WaveformPlayer::_isr()
+{
+    WaveformPlayer *self = _active;
+    if (self == nullptr)
+    {
+        return;
+    }
+    if (self->_total != 0 && self->_position >= self->_total)
+    {
+        self->_timer.end();
+        self->_running = false;
+        return;
+    }
+    const WaveformPoint &point = self->_table[self->_position % self->_length];
+    bool move_x = point.x != self->_x;
+    bool move_y = point.y != self->_y;
+    if (move_x && move_y && !AD5761::chained()) // The chain queue belongs to the main thread
+    {
+        AD5761::begin_batch();
+        self->_dac_x->write_frame(CMD_WR_UPDATE_DAC_REG, self->_dac_x->calibrate(point.x));
+        self->_dac_y->write_frame(CMD_WR_UPDATE_DAC_REG, self->_dac_y->calibrate(point.y));
+        AD5761::end_batch();
+    }
+    else
+    {
+        if (move_x)
+        {
+            self->_dac_x->write_fast(CMD_WR_UPDATE_DAC_REG, self->_dac_x->calibrate(point.x));
+        }
+        if (move_y)
+        {
+            self->_dac_y->write_fast(CMD_WR_UPDATE_DAC_REG, self->_dac_y->calibrate(point.y));
+        }
+    }
+    self->_x = point.x;
+    self->_y = point.y;
+    self->_point_cycles = CycleClock::now();
+    self->_position = self->_position + 1;
+}
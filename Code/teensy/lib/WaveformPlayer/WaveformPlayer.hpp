@@ -0,0 +1,81 @@
+/**************************************************************************/
+/*
+
+Timer-driven waveform playback on the X and Y DACs.
+
+A table of X/Y code pairs is uploaded to RAM once; a PIT timer then writes
+one point per period from its interrupt, so the DAC update rate is fixed by
+the timer and not by how long the main loop takes. Only the axes whose code
+changes are written. When both change, each DAC gets a write-and-update
+frame on its own chip select, back to back in one SPI transaction, so the
+axes change one frame time apart. On a daisy chain each axis is written
+on its own.
+
+The DACs sit on their own GPIO chip selects, so each 24-bit frame needs the
+CPU to toggle one; the interrupt does the work a DMA channel cannot.
+
+*/
+/**************************************************************************/
+
+#ifndef WAVEFORM_PLAYER_H
+#define WAVEFORM_PLAYER_H
+
+#include <Arduino.h>
+#include <IntervalTimer.h>
+#include "AD5761.hpp"
+#include "CycleClock.hpp"
+
+#define WAVEFORM_MAX_POINTS 4096
+#define WAVEFORM_MIN_HZ 10
+#define WAVEFORM_MAX_HZ 100000 // Four DAC frames per point at most
+
+struct WaveformPoint
+{
+  uint16_t x;
+  uint16_t y;
+};
+
+class WaveformPlayer
+{
+public:
+  WaveformPlayer(AD5761 *dac_x, AD5761 *dac_y); // Constructor
+
+  // Table, main thread only while stopped
+  void clear();
+  bool append(int x, int y); // False when the table is full
+  uint32_t length();
+
+  bool begin(uint32_t rate_hz, uint32_t repeats, int x_now, int y_now); // 0 repeats plays until end()
+  void end();
+  bool pause();  // Stop the timer but keep the place; false when nothing was playing
+  bool resume(); // Carry on after pause() from the next point
+  bool running(); // False while paused
+  uint32_t rate_hz();
+
+  uint32_t position(); // Points written since begin(), across repeats
+  uint32_t point_cycles(); // DWT cycle count of the latest point
+  int x();             // Nominal codes of the latest point
+  int y();
+
+  static uint32_t clamp_rate(uint32_t rate_hz);
+
+private:
+  AD5761 *_dac_x;
+  AD5761 *_dac_y;
+  IntervalTimer _timer;
+  WaveformPoint _table[WAVEFORM_MAX_POINTS];
+  uint32_t _length = 0;
+  uint32_t _rate_hz = 0;
+  uint32_t _total = 0; // Points to play, 0 for no limit
+  volatile uint32_t _position = 0;
+  volatile uint32_t _point_cycles = 0;
+  volatile int _x = 0;
+  volatile int _y = 0;
+  volatile bool _running = false;
+  bool _paused = false;
+
+  static WaveformPlayer *_active;
+  static void _isr();
+};
+
+#endif // WAVEFORM_PLAYER_H
@@ -38,21 +38,214 @@ void serialCommand(String command, STM &stm)
       int value = Serial.parseInt();
       stm.set_dac_y(value);
     }
+    // X and Y in one coordinated update
+    if (command == "DAXY")
+    {
+      int x = Serial.parseInt();
+      int y = Serial.parseInt();
+      stm.stage_dac_x(x);
+      stm.stage_dac_y(y);
+      stm.commit_dacs();
+    }
+    // Waveform table: clear, append one X,Y point, play at a rate in Hz N times (0 loops), stop
+    if (command == "WFCL")
+    {
+      stm.stop_waveform();
+      stm.waveform.clear();
+    }
+    if (command == "WFPT")
+    {
+      int x = Serial.parseInt();
+      int y = Serial.parseInt();
+      stm.waveform.append(x, y); // Dropped once the table is full
+    }
+    if (command == "WFPL")
+    {
+      int rate = Serial.parseInt();
+      int repeats = Serial.parseInt();
+      stm.play_waveform(rate, repeats > 0 ? repeats : 0);
+    }
+    if (command == "WFST")
+    {
+      stm.stop_waveform();
+    }
+    // Positions with POSITION_BITS (20-bit) resolution, dithered below one DAC LSB
+    if (command == "POSX")
+    {
+      long position = Serial.parseInt();
+      stm.set_position_x(position > 0 ? position : 0);
+    }
+    if (command == "POSY")
+    {
+      long position = Serial.parseInt();
+      stm.set_position_y(position > 0 ? position : 0);
+    }
+    if (command == "POSZ")
+    {
+      long position = Serial.parseInt();
+      stm.set_position_z(position > 0 ? position : 0);
+    }
+    // Move planner limits: slew rate in codes/s (at least 100), acceleration in codes/s^2, 0 keeps a value
+    if (command == "MVCF")
+    {
+      int rate = Serial.parseInt();
+      int accel = Serial.parseInt();
+      stm.planner.configure(rate > 0 ? rate : 0, accel > 0 ? accel : 0);
+    }
+    // Move X and Y together, replies MV,<expected duration in us> before moving
+    if (command == "MVTO")
+    {
+      int x = Serial.parseInt();
+      int y = Serial.parseInt();
+      stm.move_to(x, y, true);
+    }
+    // DAC calibration of channel 0-3 (X, Y, Z, bias): loopback sweep, clear, get. All reply with DC
+    if (command == "DCAL")
+    {
+      int channel = Serial.parseInt();
+      stm.calibrate_dac(channel);
+      stm.send_dac_calibration(channel);
+    }
+    if (command == "DCLR")
+    {
+      int channel = Serial.parseInt();
+      stm.clear_dac_calibration(channel);
+      stm.send_dac_calibration(channel);
+    }
+    if (command == "DCGT")
+    {
+      int channel = Serial.parseInt();
+      stm.send_dac_calibration(channel);
+    }
+    // DAC outputs in microvolts
+    if (command == "UVLX")
+    {
+      long microvolts = Serial.parseInt();
+      stm.set_dac_x_uv(microvolts);
+    }
+    if (command == "UVLY")
+    {
+      long microvolts = Serial.parseInt();
+      stm.set_dac_y_uv(microvolts);
+    }
+    if (command == "UVLZ")
+    {
+      long microvolts = Serial.parseInt();
+      stm.set_dac_z_uv(microvolts);
+    }
+    if (command == "UVLB")
+    {
+      long microvolts = Serial.parseInt();
+      stm.set_dac_bias_uv(microvolts);
+    }
+    // Piezo compensation of axis 0 (X) or 1 (Y): clear, linear weight, play operator, creep, enable
+    if (command == "PZCL")
+    {
+      int axis = Serial.parseInt();
+      stm.enable_piezo_compensation(axis, false);
+      (axis == 0 ? stm.piezo_x : stm.piezo_y).clear();
+    }
+    if (command == "PZW0")
+    {
+      int axis = Serial.parseInt();
+      long weight = Serial.parseInt();
+      (axis == 0 ? stm.piezo_x : stm.piezo_y).set_linear_weight(weight);
+    }
+    if (command == "PZOP")
+    {
+      int axis = Serial.parseInt();
+      int index = Serial.parseInt();
+      int threshold = Serial.parseInt();
+      long weight = Serial.parseInt();
+      (axis == 0 ? stm.piezo_x : stm.piezo_y).set_operator(index, threshold, weight);
+    }
+    if (command == "PZCR")
+    {
+      int axis = Serial.parseInt();
+      long gamma = Serial.parseInt();
+      long tau0_ms = Serial.parseInt();
+      (axis == 0 ? stm.piezo_x : stm.piezo_y).set_creep(gamma, tau0_ms > 0 ? tau0_ms : 1);
+    }
+    if (command == "PZEN")
+    {
+      int axis = Serial.parseInt();
+      int on = Serial.parseInt();
+      stm.enable_piezo_compensation(axis, on != 0);
+    }
     if (command == "DACZ")
     {
       int value = Serial.parseInt();
       stm.set_dac_z(value);
     }
+    // DAC write benchmark with N writes per method
+    if (command == "DBNC")
+    {
+      int n = Serial.parseInt();
+      stm.benchmark_dac_writes(n > 0 ? n : 10000);
+    }
     // ADC READ
     if (command == "ADCR")
     {
       int val = stm.read_adc();
       Serial.println(val);
     }
+    // Decimation of the control and pixel samples, CIC rate change and FIR compensation on/off
+    if (command == "DECI")
+    {
+      int decimation = Serial.parseInt();
+      int compensation = Serial.parseInt();
+      stm.set_decimation(decimation, compensation != 0);
+    }
+    // Burst capture of N raw samples at a rate in Hz, sent back as one binary block
+    if (command == "BRST")
+    {
+      int n = Serial.parseInt();
+      int rate = Serial.parseInt();
+      stm.capture_burst(n, rate > 0 ? rate : SAMPLE_CLOCK_MAX_HZ);
+      stm.send_burst();
+    }
+    // Noise spectrum averaged over N blocks at a rate in Hz
+    if (command == "FFTM")
+    {
+      int n_avg = Serial.parseInt();
+      int rate = Serial.parseInt();
+      stm.measure_noise_spectrum(n_avg, rate > 0 ? rate : SAMPLE_CLOCK_MAX_HZ);
+      stm.send_noise_spectrum();
+    }
+    // Overcurrent retract threshold in ADC counts, 0 disables it
+    if (command == "OCTH")
+    {
+      int threshold = Serial.parseInt();
+      stm.overcurrent.arm(threshold);
+    }
+    // Clear a latched overcurrent fault
+    if (command == "FLTC")
+    {
+      stm.clear_fault();
+    }
+    // ADC sample clock rate in Hz
+    if (command == "ADCF")
+    {
+      int rate = Serial.parseInt();
+      stm.set_sample_rate(rate);
+    }
+    // Continuous ADC stream, rate in Hz, 0 stops it
+    if (command == "STRM")
+    {
+      int rate = Serial.parseInt();
+      if (rate > 0)
+      {
+        stm.start_stream(rate);
+      }
+      else
+      {
+        stm.stop_stream();
+      }
+    }
     // Get status
     if (command == "GSTS")
     {
-      char buffer[100];
+      char buffer[200];
       stm.get_status().to_char(buffer);
       Serial.println(buffer);
     }
@@ -82,6 +275,12 @@ void serialCommand(String command, STM &stm)
       int adc_target = Serial.parseInt();
       stm.turn_on_const_current(adc_target);
     }
+    // Constant-current loop rate in Hz from a timer interrupt, 0 runs it from the main loop
+    if (command == "CCFR")
+    {
+      int rate = Serial.parseInt();
+      stm.set_feedback_rate(rate > 0 ? rate : 0);
+    }
     // Turn off const current
     if (command == "CCOF")
     {
@@ -93,9 +292,47 @@ void serialCommand(String command, STM &stm)
       double Kp = Serial.parseFloat();
       double Ki = Serial.parseFloat();
       double Kd = Serial.parseFloat();
-      stm.Kp = Kp;
-      stm.Ki = Ki;
-      stm.Kd = Kd;
+      stm.set_pid(Kp, Ki, Kd);
+    }
+    // Relay auto-tune: Z step, hysteresis (0 for defaults), apply, rule 0 PI / 1 PID
+    if (command == "ATUN")
+    {
+      int amplitude = Serial.parseInt();
+      int hysteresis = Serial.parseInt();
+      int apply = Serial.parseInt();
+      int rule = Serial.parseInt();
+      stm.autotune_current(amplitude, hysteresis, apply != 0, rule);
+    }
+    // Derivative low-pass pole and integrator back-calculation gain
+    if (command == "PIDF")
+    {
+      double pole = Serial.parseFloat();
+      double tracking = Serial.parseFloat();
+      stm.set_pid_filter(pole, tracking);
+    }
+    // Constant-current controller benchmark, N updates of each implementation
+    if (command == "PIDB")
+    {
+      int n = Serial.parseInt();
+      stm.benchmark_pid(n > 0 ? n : 10000);
+    }
+    // Logarithm benchmark, N calls of each implementation
+    if (command == "LOGB")
+    {
+      int n = Serial.parseInt();
+      stm.benchmark_log(n > 0 ? n : 10000);
+    }
+    // Scan image channels as a bit mask: A, Z, AV, AN, AX, ZV, ZN, ZX
+    if (command == "SCCH")
+    {
+      int mask = Serial.parseInt();
+      stm.set_scan_channels(mask);
+    }
+    // Fast-axis point rate of timer-paced scan lines in Hz, 0 for CPU-paced lines
+    if (command == "SCLR")
+    {
+      int rate = Serial.parseInt();
+      stm.set_scan_line_rate(rate > 0 ? rate : 0);
     }
     if (command == "SCST")
     {
@@ -161,8 +398,8 @@ void loop()
   {
     stm.approach();
   }
-  if (stm.stm_status.is_const_current)
+  if (stm.stm_status.is_const_current && !stm.feedback_in_isr())
   {
-    stm.control_current(stm.read_adc_raw());
+    stm.control_current(stm.read_adc_decimated());
   }
 }
@@ -15,7 +15,24 @@ STM Firmware for Teensy 4.1
 #include <ArduinoJson.h>
 #include "EfficientStepper.hpp"
 #include "AD5761.hpp"
+#include "AdcStream.hpp"
+#include "Ltc2326DmaBackend.hpp"
+#include "SampleClock.hpp"
+#include "CycleClock.hpp"
+#include "CicDecimator.hpp"
+#include "FilterBank.hpp"
+#include "NoiseSpectrum.hpp"
+#include "OvercurrentGuard.hpp"
+#include "PixelStats.hpp"
+#include "WaveformPlayer.hpp"
+#include "SigmaDeltaDac.hpp"
+#include "TrajectoryPlanner.hpp"
+#include "PiezoCompensator.hpp"
+#include "FixedPidController.hpp"
+#include "FastLog.hpp"
+#ifdef STM_LOG_TABLE_BENCHMARK
 #include <logTable.hpp>
+#endif
 
 #define CS_ADC 38    // ADC chip select pin
 #define ADC_MISO 39  // ADC MISO
@@ -30,17 +47,31 @@ STM Firmware for Teensy 4.1
 #define DAC_2 9  //
 #define DAC_4 10 //
 
+// Daisy-chained DACs (build with -D DAC_DAISY_CHAIN): all four share the
+// DAC_1 chip select. Positions count from the device wired to MOSI.
+#define DAC_CHAIN_POS_X 0
+#define DAC_CHAIN_POS_Y 1
+#define DAC_CHAIN_POS_Z 2
+#define DAC_CHAIN_POS_BIAS 3
+
 // DAC and ADC resolution:
 #define DAC_BITS 16      // Actual DAC resolution
 #define POSITION_BITS 20 // Sigma-delta resolution
 #define ADC_BITS 16
 
+static_assert(POSITION_BITS - DAC_BITS == SIGMA_DELTA_FRACTION_BITS, "Sigma-delta fraction must fill POSITION_BITS");
+
 const int MAX_DAC_OUT = (1 << (DAC_BITS - 1)) - 1; // DAC upper bound
 const int MIN_DAC_OUT = -(1 << (DAC_BITS - 1));    // DAC lower bound
 
 // ADC Settings
 LTC2326_16 ltc2326 = LTC2326_16(CS_ADC, CNV, BUSY);
 
+// Burst capture buffers live in the 512 KB OCRAM, away from the tightly coupled RAM
+#define BURST_MAX_SAMPLES 32768
+DMAMEM int16_t burst_adc[BURST_MAX_SAMPLES];
+DMAMEM uint32_t burst_time_ns[BURST_MAX_SAMPLES]; // Relative to the first sample
+
 // initialize the stepper library
 // ULN2003 Motor Driver Pins
 #define IN1 33
@@ -54,8 +85,98 @@ LTC2326_16 ltc2326 = LTC2326_16(CS_ADC, CNV, BUSY);
 #define INIT_KP 2.0
 #define INIT_KI 1.0
 #define INIT_KD 1.0
+#define PID_DERIVATIVE_POLE 0.8 // Default pole of the derivative low pass, per update
+#define PID_TRACKING_GAIN 0.5   // Default back-calculation gain of the integrator
+#define FEEDBACK_Z_MIN 10000    // Z range the constant-current loop may drive
+#define FEEDBACK_Z_MAX 50000
+#define FEEDBACK_Z_MID 32768    // Z for a zero controller output
+#define AUTOTUNE_SETTLE_PERIODS 2       // Relay periods discarded before measuring
+#define AUTOTUNE_PERIODS 6              // Relay periods averaged
+#define AUTOTUNE_TIMEOUT_US 5000000     // Longest relay experiment
+#define AUTOTUNE_DEFAULT_AMPLITUDE 200  // Relay step in Z codes either side of the present Z
+#define AUTOTUNE_DEFAULT_HYSTERESIS 2000 // Relay hysteresis in log-current units
+
+#define FEEDBACK_MIN_HZ 1000   // Slowest interrupt-driven Z loop
+#define FEEDBACK_MAX_HZ 100000 // Fastest interrupt-driven Z loop
+#define MOVE_STALL_US 10000 // Extra time a move waits for ADC samples before it finishes unpaced
 
-#define MOVE_SPEED 1
+#define ADC_TIMEOUT_PERIODS 3    // Longest wait for a fresh ADC sample, in sample periods...
+#define ADC_TIMEOUT_MARGIN_US 20 // ... plus this much for interrupt latency
+
+#define OVERCURRENT_THRESHOLD (MAX_ADC_OUT - 512) // |adc| that counts as a tip crash
+#define Z_RETRACT_DAC 10000                        // Z code the guard retracts to
+
+// Scan image channels. SCCH takes a bit mask of them; A and Z are the default.
+enum ScanChannel
+{
+    SCAN_ADC_MEAN,
+    SCAN_Z_MEAN,
+    SCAN_ADC_VAR,
+    SCAN_ADC_MIN,
+    SCAN_ADC_MAX,
+    SCAN_Z_VAR,
+    SCAN_Z_MIN,
+    SCAN_Z_MAX,
+    SCAN_CHANNELS
+};
+const char *const SCAN_CHANNEL_PREFIX[SCAN_CHANNELS] = {"A", "Z", "AV", "AN", "AX", "ZV", "ZN", "ZX"};
+#define SCAN_DEFAULT_CHANNELS ((1 << SCAN_ADC_MEAN) | (1 << SCAN_Z_MEAN))
+#define SCAN_MAX_PIXELS 2048
+
+enum DacChannel
+{
+    DAC_CH_X,
+    DAC_CH_Y,
+    DAC_CH_Z,
+    DAC_CH_BIAS,
+    DAC_CHANNELS
+};
+
+// DAC control register modes. The output range of each channel, and with it
+// the microvolt conversion, follows from these at compile time.
+#define DAC_MODE_X RANGE_PM_3V
+#define DAC_MODE_Y RANGE_PM_3V
+#define DAC_MODE_Z RANGE_PM_10V
+#define DAC_MODE_BIAS RANGE_PM_3V
+typedef AD5761Range<DAC_MODE_X> DacRangeX;
+typedef AD5761Range<DAC_MODE_Y> DacRangeY;
+typedef AD5761Range<DAC_MODE_Z> DacRangeZ;
+typedef AD5761Range<DAC_MODE_BIAS> DacRangeBias;
+static_assert(DacRangeX::code(0) == 32768, "X range must be bipolar");
+
+// Output range of each DAC channel in mV and the LTC2326-16 input range,
+// used by the loopback calibration.
+const int32_t DAC_RANGE_MIN_MV[DAC_CHANNELS] = {DacRangeX::min_uv() / 1000, DacRangeY::min_uv() / 1000, DacRangeZ::min_uv() / 1000, DacRangeBias::min_uv() / 1000};
+const int32_t DAC_RANGE_MAX_MV[DAC_CHANNELS] = {DacRangeX::max_uv() / 1000, DacRangeY::max_uv() / 1000, DacRangeZ::max_uv() / 1000, DacRangeBias::max_uv() / 1000};
+#define ADC_FULL_SCALE_MV 10240
+#define DAC_CAL_SETTLE_MS 2  // Output settling after each calibration step
+#define DAC_CAL_SAMPLES 256  // ADC samples averaged per calibration step
+
+// ADC filter of each consumer, see FilterBank.hpp
+typedef BoxcarFilter<4> StatusAdcFilter;       // 16-sample average of raw conversions for ADCR
+typedef EmaFilter<1> FeedbackAdcFilter;        // alpha = 1/2, little delay in the Z loop and approach
+typedef MedianFilter<5> SpectroscopyAdcFilter; // Median of 5 fresh samples per IV / dI point
+// Scan pixels need no filter of their own: PixelStats averages the unfiltered
+// samples of each pixel, so the variance channels see the real noise.
+#define SPECTROSCOPY_SAMPLES 5
+
+// Decimal text of a 64-bit value, since sprintf has no portable format for it.
+char *u64_to_char(uint64_t value, char *buffer)
+{
+    char digits[21];
+    int n = 0;
+    do
+    {
+        digits[n++] = '0' + static_cast<char>(value % 10);
+        value /= 10;
+    } while (value > 0);
+    for (int i = 0; i < n; ++i)
+    {
+        buffer[i] = digits[n - 1 - i];
+    }
+    buffer[n] = '\0';
+    return buffer;
+}
 
 class STMStatus
 {
@@ -70,10 +191,17 @@ public:
     bool is_const_current = false;
     bool is_scanning = false;
     uint32_t time_millis = 0;
+    uint32_t sample_rate = 0;
+    uint64_t time_micros = 0; // Conversion start of the ADC sample in adc
+    uint32_t latency_ns = 0;  // Sample to Z update in the last control_current()
+    bool fault = false;       // Overcurrent retract latched, cleared by FLTC
+    uint32_t dac_writes = 0;  // DAC commands sent, all channels
+    uint32_t dac_elided = 0;  // DAC updates skipped because the code was unchanged
 
     void to_char(char *buffer)
     {
-        sprintf(buffer, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%lu", bias, dac_z, dac_x, dac_y, adc, steps, is_approaching, is_const_current, is_scanning, time_millis);
+        char micros_buffer[21];
+        sprintf(buffer, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%lu,%lu,%s,%lu,%d,%lu,%lu", bias, dac_z, dac_x, dac_y, adc, steps, is_approaching, is_const_current, is_scanning, time_millis, sample_rate, u64_to_char(time_micros, micros_buffer), latency_ns, fault, dac_writes, dac_elided);
     }
 };
 
@@ -84,6 +212,50 @@ struct Approach_Config
     int step_interval;
 };
 
+// Input of the interrupt-driven Z loop. While the loop runs, the sample hook
+// pushes every conversion through its own decimator, set up like the main
+// thread's, so a control tick gets the same oversampled value that
+// read_adc_decimated() gives the callers. Each output is published with a
+// count the loop uses to tell a fresh one from the last.
+struct FeedbackInput
+{
+    CicDecimator decimator = CicDecimator();
+    volatile bool enabled = false; // Cleared before the main thread touches the decimator
+    volatile int32_t value = 0;
+    volatile uint32_t outputs = 0;
+
+    void push_isr(int16_t sample)
+    {
+        int32_t out;
+        if (enabled && decimator.push(sample, out))
+        {
+            value = out;
+            outputs = outputs + 1;
+        }
+    }
+    // Newest output and its count, consistent even if the hook runs in between
+    int32_t latest(uint32_t &count)
+    {
+        int32_t out;
+        do
+        {
+            count = outputs;
+            out = value;
+        } while (count != outputs);
+        return out;
+    }
+};
+FeedbackInput feedback_input;
+
+// Sample hook of both acquisition paths: the overcurrent check, one
+// sigma-delta step of every dithered position, then the Z loop's decimator.
+void stm_sample_isr(int16_t sample)
+{
+    OvercurrentGuard::check_isr(sample);
+    SigmaDeltaDac::step_all_isr();
+    feedback_input.push_isr(sample);
+}
+
 double clamp_value(double value, double min_value, double max_value)
 {
     if (value > max_value)
@@ -114,8 +286,25 @@ public: // Access specifier
         dac_y.reset();
         dac_z.reset();
         dac_bias.reset();
+        for (int channel = 0; channel < DAC_CHANNELS; ++channel)
+        {
+            _calibration[channel].load(channel);
+            _dac(channel).set_calibration(&_calibration[channel]);
+        }
         stm_status = STMStatus();
-        ltc2326.convert();
+        CycleClock::begin();
+        overcurrent.begin();
+        overcurrent.clear();
+        overcurrent.arm(OVERCURRENT_THRESHOLD);
+        _position_x.begin();
+        _position_y.begin();
+        _position_z.begin();
+        _position_z.set_inhibit(OvercurrentGuard::retracted); // Never dither Z off the retract code
+        _fixed_pid.set_limits(FEEDBACK_Z_MIN - FEEDBACK_Z_MID, FEEDBACK_Z_MAX - FEEDBACK_Z_MID);
+        set_pid_filter(pid_derivative_pole, pid_tracking);
+        ltc2326.set_sample_hook(stm_sample_isr);
+        _adc_dma.set_sample_hook(stm_sample_isr);
+        stop_stream();
     }
     // STM motors
     EfficientStepper stepper_motor = EfficientStepper(STEPS_PER_REVOLUTION, IN1, IN3, IN2, IN4);
@@ -123,51 +312,454 @@ public: // Access specifier
     // DACs
     void set_dac_z(int value)
     {
-        dac_z.write(CMD_WR_UPDATE_DAC_REG, value);
+        if (check_fault())
+        {
+            return; // Z stays retracted until the fault is cleared
+        }
+        _position_z.release();
+        dac_z.write_code(value);
         stm_status.dac_z = value;
         stm_status.time_millis = millis();
     }
     void set_dac_x(int value)
     {
-        dac_x.write(CMD_WR_UPDATE_DAC_REG, value);
+        _release_waveform();
+        _position_x.release();
+        dac_x.write_code(_output_code(DAC_CH_X, value));
         stm_status.dac_x = value;
         stm_status.time_millis = millis();
     }
     void set_dac_y(int value)
     {
-        dac_y.write(CMD_WR_UPDATE_DAC_REG, value);
+        _release_waveform();
+        _position_y.release();
+        dac_y.write_code(_output_code(DAC_CH_Y, value));
         stm_status.dac_y = value;
         stm_status.time_millis = millis();
     }
     void set_dac_bias(int value)
     {
-        dac_bias.write(CMD_WR_UPDATE_DAC_REG, value);
+        dac_bias.write_code(value);
         stm_status.bias = value;
         stm_status.time_millis = millis();
     }
-    // ADC
+    // Outputs in microvolts, converted with the constants of each channel's
+    // range. The result is a nominal code, calibrated like any other write.
+    void set_dac_x_uv(int32_t microvolts) { set_dac_x(DacRangeX::code(microvolts)); }
+    void set_dac_y_uv(int32_t microvolts) { set_dac_y(DacRangeY::code(microvolts)); }
+    void set_dac_z_uv(int32_t microvolts) { set_dac_z(DacRangeZ::code(microvolts)); }
+    void set_dac_bias_uv(int32_t microvolts) { set_dac_bias(DacRangeBias::code(microvolts)); }
+    // Coordinated updates. commit_dacs() sends every staged channel a
+    // write-and-update command, back to back in one SPI transaction, so the
+    // axes change within one 24-bit frame time of each other. With separate
+    // chip selects and no shared LDAC, writing the input registers first and
+    // updating afterwards would only double the traffic. On a daisy chain
+    // every staged channel is written and updated in the same frame, so they
+    // change together.
+    void stage_dac_x(int value) { _stage(DAC_CH_X, value); }
+    void stage_dac_y(int value) { _stage(DAC_CH_Y, value); }
+    void stage_dac_z(int value) { _stage(DAC_CH_Z, value); }
+    void stage_dac_bias(int value) { _stage(DAC_CH_BIAS, value); }
+    void commit_dacs()
+    {
+        if ((_staged_mask & (1 << DAC_CH_Z)) && check_fault())
+        {
+            _staged_mask &= ~(1 << DAC_CH_Z);
+        }
+        uint32_t requested = _staged_mask;
+        uint16_t code[DAC_CHANNELS];
+        for (int channel = 0; channel < DAC_CHANNELS; ++channel)
+        {
+            if (!(requested & (1 << channel)))
+            {
+                continue;
+            }
+            code[channel] = _dac(channel).calibrate(_output_code(channel, _staged[channel]));
+            if (_dac(channel).elide(code[channel]))
+            {
+                _staged_mask &= ~(1 << channel); // Register already holds the code
+            }
+        }
+        if (_staged_mask & ((1 << DAC_CH_X) | (1 << DAC_CH_Y)))
+        {
+            _release_waveform();
+        }
+        if (_staged_mask & (1 << DAC_CH_X))
+        {
+            _position_x.release();
+        }
+        if (_staged_mask & (1 << DAC_CH_Y))
+        {
+            _position_y.release();
+        }
+        if (_staged_mask & (1 << DAC_CH_Z))
+        {
+            _position_z.release();
+        }
+        if (_staged_mask != 0)
+        {
+            AD5761::begin_batch();
+            for (int channel = 0; channel < DAC_CHANNELS; ++channel)
+            {
+                if (_staged_mask & (1 << channel))
+                {
+                    _dac(channel).write_frame(CMD_WR_UPDATE_DAC_REG, code[channel]);
+                }
+            }
+            AD5761::end_batch();
+        }
+        for (int channel = 0; channel < DAC_CHANNELS; ++channel)
+        {
+            if (requested & (1 << channel))
+            {
+                _status_code(channel) = _staged[channel];
+            }
+        }
+        _staged_mask = 0;
+        stm_status.time_millis = millis();
+    }
+    // Piezo hysteresis and creep compensation of X and Y. The compensators
+    // turn the target codes kept in stm_status into the codes sent; update()
+    // keeps re-applying them so creep is corrected while the target holds.
+    PiezoCompensator piezo_x = PiezoCompensator();
+    PiezoCompensator piezo_y = PiezoCompensator();
+    void enable_piezo_compensation(int axis, bool on)
+    {
+        PiezoCompensator &piezo = axis == 0 ? piezo_x : piezo_y;
+        int &target = axis == 0 ? stm_status.dac_x : stm_status.dac_y;
+        piezo.enable(on, target, micros());
+        if (axis == 0)
+        {
+            set_dac_x(target);
+        }
+        else
+        {
+            set_dac_y(target);
+        }
+    }
+    // Positions with POSITION_BITS of resolution. The part below one DAC LSB
+    // is dithered by the sample hook at the sample clock rate; stm_status
+    // keeps the integer DAC code. The modulator writes raw codes from the
+    // ISR, so X and Y positions are refused while that axis has piezo
+    // compensation enabled; use set_dac_x/y there.
+    bool set_position_x(uint32_t position)
+    {
+        if (piezo_x.enabled())
+        {
+            return false;
+        }
+        _release_waveform();
+        _position_x.set(position);
+        stm_status.dac_x = _position_x.code();
+        stm_status.time_millis = millis();
+        return true;
+    }
+    bool set_position_y(uint32_t position)
+    {
+        if (piezo_y.enabled())
+        {
+            return false;
+        }
+        _release_waveform();
+        _position_y.set(position);
+        stm_status.dac_y = _position_y.code();
+        stm_status.time_millis = millis();
+        return true;
+    }
+    void set_position_z(uint32_t position)
+    {
+        if (check_fault())
+        {
+            return;
+        }
+        _position_z.set(position);
+        stm_status.dac_z = _position_z.code();
+        stm_status.time_millis = millis();
+    }
+    // Loopback calibration of one DAC channel. Retract the tip and wire the
+    // DAC output to the ADC input first. Every breakpoint code is sent
+    // uncorrected, the averaged ADC reading is converted to nominal codes of
+    // the channel's range, and the inverted table goes to EEPROM.
+    bool calibrate_dac(int channel)
+    {
+        if (channel < 0 || channel >= DAC_CHANNELS || stm_status.is_const_current || stm_status.is_approaching || check_fault())
+        {
+            return false;
+        }
+        _release_waveform();
+        _position_x.release();
+        _position_y.release();
+        _position_z.release();
+        int threshold = overcurrent.armed() ? overcurrent.threshold() : 0;
+        overcurrent.disarm(); // The loopback reads close to full scale
+        AD5761 &dac = _dac(channel);
+        int64_t span_mv = DAC_RANGE_MAX_MV[channel] - DAC_RANGE_MIN_MV[channel];
+        int32_t measured[DAC_CAL_POINTS];
+        for (unsigned i = 0; i < DAC_CAL_POINTS; ++i)
+        {
+            dac.write_fast(CMD_WR_UPDATE_DAC_REG, DacCalibration::breakpoint_code(i));
+            delay(DAC_CAL_SETTLE_MS);
+            int64_t sum = 0;
+            for (int k = 0; k < DAC_CAL_SAMPLES; ++k)
+            {
+                sum += read_adc_decimated();
+            }
+            // (mean mV - range minimum) / span * 65536, in one rounded division
+            int64_t numerator = (sum * ADC_FULL_SCALE_MV - static_cast<int64_t>(DAC_RANGE_MIN_MV[channel]) * 32768 * DAC_CAL_SAMPLES) * 65536;
+            int64_t denominator = span_mv * 32768 * DAC_CAL_SAMPLES;
+            measured[i] = static_cast<int32_t>((numerator + (numerator >= 0 ? denominator / 2 : -denominator / 2)) / denominator);
+        }
+        bool ok = _calibration[channel].build(measured);
+        if (ok)
+        {
+            _calibration[channel].save(channel);
+        }
+        dac.write_fast(CMD_WR_UPDATE_DAC_REG, dac.calibrate(_status_code(channel)));
+        if (threshold > 0)
+        {
+            overcurrent.arm(threshold);
+        }
+        return ok;
+    }
+    void clear_dac_calibration(int channel)
+    {
+        if (channel < 0 || channel >= DAC_CHANNELS)
+        {
+            return;
+        }
+        _calibration[channel].identity();
+        _calibration[channel].save(channel);
+    }
+    // DC,<channel>,<calibrated>,<code sent at each breakpoint>
+    void send_dac_calibration(int channel)
+    {
+        if (channel < 0 || channel >= DAC_CHANNELS)
+        {
+            Serial.printf("DC,%d,0\r\n", channel);
+            return;
+        }
+        Serial.printf("DC,%d,%d", channel, !_calibration[channel].is_identity());
+        for (unsigned i = 0; i < DAC_CAL_POINTS; ++i)
+        {
+            Serial.printf(",%ld", _calibration[channel].point(i));
+        }
+        Serial.print("\r\n");
+    }
+    // Waveform playback. The table of X/Y codes is written by a timer
+    // interrupt at a fixed rate; the main loop keeps running the feedback.
+    // Any main-thread X or Y write stops it first.
+    WaveformPlayer waveform = WaveformPlayer(&dac_x, &dac_y);
+    bool play_waveform(uint32_t rate_hz, uint32_t repeats)
+    {
+        SPI.usingInterrupt(IRQ_PIT); // The player writes X and Y from a PIT interrupt
+        _position_x.release();
+        _position_y.release();
+        _waveform_active = waveform.begin(rate_hz, repeats, stm_status.dac_x, stm_status.dac_y);
+        return _waveform_active;
+    }
+    void stop_waveform()
+    {
+        waveform.end();
+        _sync_waveform();
+    }
+    // DAC write benchmark. Rewrites the codes the DAC registers already hold,
+    // calibration and compensation included, so the outputs do not move, and
+    // reports updates per second for the legacy three-byte write, the single
+    // 24-bit frame and a batch of all four. Reports zeros while any register
+    // is unknown, i.e. after a reset and before its first update.
+    void benchmark_dac_writes(int n)
+    {
+        if (!dac_x.shadow_valid() || !dac_y.shadow_valid() || !dac_z.shadow_valid() || !dac_bias.shadow_valid())
+        {
+            Serial.printf("DB,0,0,0\r\n");
+            return;
+        }
+        uint16_t code_x = dac_x.shadow();
+        uint16_t code_y = dac_y.shadow();
+        uint16_t code_z = dac_z.shadow();
+        uint16_t code_bias = dac_bias.shadow();
+        uint32_t start = CycleClock::now();
+        for (int i = 0; i < n; ++i)
+        {
+            dac_x.write(CMD_WR_UPDATE_DAC_REG, code_x);
+        }
+        uint32_t legacy_cycles = CycleClock::now() - start;
+
+        start = CycleClock::now();
+        for (int i = 0; i < n; ++i)
+        {
+            dac_x.write_fast(CMD_WR_UPDATE_DAC_REG, code_x);
+        }
+        uint32_t fast_cycles = CycleClock::now() - start;
+
+        start = CycleClock::now();
+        for (int i = 0; i < n; ++i)
+        {
+            AD5761::begin_batch();
+            dac_x.write_frame(CMD_WR_UPDATE_DAC_REG, code_x);
+            dac_y.write_frame(CMD_WR_UPDATE_DAC_REG, code_y);
+            dac_z.write_frame(CMD_WR_UPDATE_DAC_REG, code_z);
+            dac_bias.write_frame(CMD_WR_UPDATE_DAC_REG, code_bias);
+            AD5761::end_batch();
+        }
+        uint32_t batch_cycles = CycleClock::now() - start;
+
+        Serial.printf("DB,%lu,%lu,%lu\r\n", _updates_per_second(n, legacy_cycles), _updates_per_second(n, fast_cycles), _updates_per_second(4 * n, batch_cycles));
+    }
+    // Longest wait for a fresh sample at the present sample rate
+    uint32_t adc_timeout_us()
+    {
+        return ADC_TIMEOUT_PERIODS * 1000000UL / sample_clock.rate_hz() + ADC_TIMEOUT_MARGIN_US;
+    }
+    // ADC. Waits for the next sample, up to adc_timeout_us(), and never polls BUSY.
     int read_adc_raw()
     {
-        int start_time = millis();
-        while (ltc2326.busy() && millis() - start_time <= 1)
+        int16_t val = 0;
+        if (adc_stream.running())
         {
-            continue;
+            adc_stream.wait_next(val, _adc_cycles, adc_timeout_us());
+        }
+        else if (ltc2326.wait_next(_adc_seq, val, _adc_cycles, adc_timeout_us()))
+        {
+            int32_t out = 0;
+            if (_decimate_busy(val, out))
+            {
+                _adc_decimated = out;
+            }
         }
-        int val = ltc2326.read();
-        this->_add_adc_value(val);
-        ltc2326.convert();
+        _status_filter.push(val);
         return val;
     }
+    // One CIC-filtered sample per call, built from the next R consecutive
+    // conversions. Used wherever a control tick or a pixel needs one value.
+    // The filter state carries over only while the input stays contiguous.
+    // When samples were skipped, the decimator restarts: on the stream from
+    // the newest settle_samples() conversions already in the ring, on the
+    // BUSY interrupt path from the next ones. On the BUSY path every reader,
+    // read_adc_raw() included, feeds the decimator, so only conversions that
+    // nobody read count as a gap.
+    CicDecimator decimator = CicDecimator();
+    int read_adc_decimated()
+    {
+        uint32_t settle = decimator.settle_samples();
+        if (adc_stream.running() && adc_stream.available() > settle)
+        {
+            // Start from fresh samples rather than work through a stale backlog
+            adc_stream.skip_to(settle);
+            decimator.reset();
+        }
+        int16_t val = 0;
+        int32_t out = _adc_decimated;
+        while (_next_sample(val))
+        {
+            if (adc_stream.running() ? decimator.push(val, out) : _decimate_busy(val, out))
+            {
+                break;
+            }
+        }
+        _adc_decimated = out;
+        return out;
+    }
+    void set_decimation(int decimation, bool compensation)
+    {
+        bool in_isr = _feedback_timer_running;
+        _stop_feedback_timer();
+        decimator.set_decimation(decimation);
+        decimator.set_compensation(compensation);
+        if (in_isr)
+        {
+            _start_feedback_timer(); // The loop's decimator follows
+        }
+    }
+    // Conversion start of the last sample read
+    uint64_t sample_micros()
+    {
+        return CycleClock::to_micros(CycleClock::extend(_adc_cycles));
+    }
     int read_adc()
     {
         read_adc_raw();
-        return _get_adc_avg();
+        return _status_filter.value();
+    }
+    int read_adc_feedback()
+    {
+        return _feedback_filter.push(read_adc_decimated());
+    }
+    int read_adc_spectroscopy()
+    {
+        for (unsigned i = 0; i < SPECTROSCOPY_SAMPLES; ++i)
+        {
+            _spectroscopy_filter.push(read_adc_decimated());
+        }
+        return _spectroscopy_filter.value();
+    }
+    // Continuous acquisition. While the stream runs, read_adc_raw() returns
+    // the newest sample from the ring instead of the BUSY interrupt reads.
+    // Both paths take their conversions from sample_clock.
+    bool start_stream(uint32_t rate_hz)
+    {
+        ltc2326.end_interrupt();
+        if (adc_stream.begin(rate_hz))
+        {
+            SPI.usingInterrupt(_adc_dma.irq());
+            return true;
+        }
+        _begin_acquisition();
+        return false;
+    }
+    void stop_stream()
+    {
+        adc_stream.end();
+        _begin_acquisition();
+    }
+    void set_sample_rate(uint32_t rate_hz)
+    {
+        if (adc_stream.running())
+        {
+            adc_stream.begin(rate_hz);
+        }
+        else
+        {
+            sample_clock.set_rate(rate_hz);
+        }
     }
     void update()
     {
         int adc_val = read_adc_raw();
         stm_status.adc = adc_val;
+        stm_status.sample_rate = sample_clock.rate_hz();
+        stm_status.time_micros = sample_micros();
         stm_status.time_millis = millis();
+        _sync_waveform();
+        _hold_piezo();
+        stm_status.dac_writes = dac_x.writes_issued() + dac_y.writes_issued() + dac_z.writes_issued() + dac_bias.writes_issued();
+        stm_status.dac_elided = dac_x.writes_elided() + dac_y.writes_elided() + dac_z.writes_elided() + dac_bias.writes_elided();
+        check_fault();
+    }
+    // Overcurrent protection. The retract itself happens in the acquisition
+    // ISR; this brings the main-thread state in line with it.
+    OvercurrentGuard overcurrent = OvercurrentGuard(&dac_z, Z_RETRACT_DAC);
+    bool check_fault()
+    {
+        if (!overcurrent.tripped())
+        {
+            return false;
+        }
+        if (!stm_status.fault)
+        {
+            stm_status.fault = true;
+            stm_status.dac_z = overcurrent.retract_code();
+            stm_status.is_const_current = false;
+            stm_status.is_approaching = false;
+            stm_status.is_scanning = false;
+            stepper_motor.disable();
+        }
+        return true;
+    }
+    void clear_fault()
+    {
+        overcurrent.clear();
+        stm_status.fault = false;
     }
     // Return the adc status.
     STMStatus get_status()
@@ -196,7 +788,11 @@ public: // Access specifier
                     set_dac_z(z_value);
                     delayMicroseconds(100);
                     update();
-                    if (read_adc() > approach_config.target_dac)
+                    if (stm_status.fault)
+                    {
+                        return false;
+                    }
+                    if (read_adc_feedback() > approach_config.target_dac)
                     {
                         Serial.println("Approached!");
                         Serial.println(stm_status.adc);
@@ -226,7 +822,7 @@ public: // Access specifier
             if (i >= 1000)
                 break;
             set_dac_bias(bias);
-            int adc = read_adc();
+            int adc = read_adc_spectroscopy();
             iv_adc[i] = adc;
             iv_bias[i] = bias;
             i++;
@@ -258,7 +854,7 @@ public: // Access specifier
             if (i >= 1000)
                 break;
             set_dac_z(z);
-            int adc = read_adc();
+            int adc = read_adc_spectroscopy();
             di_adc[i] = adc;
             di_z[i] = z;
             i++;
@@ -277,6 +873,130 @@ public: // Access specifier
         }
         Serial.print("\r\n");
     }
+    // Burst capture: N consecutive raw conversions at rate_hz with the DAC
+    // outputs held. Everything that writes the DACs by itself is suspended
+    // for the capture and resumed afterwards: the timer-driven Z loop, a
+    // playing waveform and the sigma-delta dither. Only the overcurrent
+    // guard may still act, and a trip shows in the data.
+    int burst_N = 0;
+    uint32_t burst_rate = 0;
+    uint64_t burst_start_us = 0;
+    uint32_t burst_overruns = 0;
+    bool capture_burst(int n, uint32_t rate_hz)
+    {
+        if (n <= 0 || n > BURST_MAX_SAMPLES)
+        {
+            n = BURST_MAX_SAMPLES;
+        }
+        bool was_streaming = adc_stream.running();
+        uint32_t previous_rate = sample_clock.rate_hz();
+        bool feedback = _feedback_timer_running;
+        _stop_feedback_timer();
+        bool waveform_paused = waveform.pause();
+        SigmaDeltaDac::suspend_all(true);
+        if (!start_stream(rate_hz))
+        {
+            _resume_dac_writers(feedback, waveform_paused);
+            return false;
+        }
+        burst_rate = sample_clock.rate_hz();
+        int i = 0;
+        int16_t val;
+        uint32_t cycles;
+        uint32_t first_cycles = 0;
+        uint32_t timeout_us = adc_timeout_us();
+        uint32_t start_time = micros();
+        while (i < n)
+        {
+            if (adc_stream.pop(val, cycles))
+            {
+                if (i == 0)
+                {
+                    first_cycles = cycles;
+                    burst_start_us = CycleClock::to_micros(CycleClock::extend(cycles));
+                }
+                burst_adc[i] = val;
+                burst_time_ns[i] = CycleClock::to_nanos(cycles - first_cycles);
+                i++;
+                start_time = micros();
+            }
+            else if (micros() - start_time > timeout_us)
+            {
+                break;
+            }
+        }
+        burst_N = i;
+        burst_overruns = adc_stream.overruns();
+        if (was_streaming)
+        {
+            start_stream(previous_rate);
+        }
+        else
+        {
+            sample_clock.set_rate(previous_rate);
+            stop_stream();
+        }
+        _resume_dac_writers(feedback, waveform_paused);
+        return burst_N == n;
+    }
+    void _resume_dac_writers(bool feedback, bool waveform_paused)
+    {
+        SigmaDeltaDac::suspend_all(false);
+        if (waveform_paused)
+        {
+            waveform.resume();
+        }
+        if (feedback)
+        {
+            _start_feedback_timer();
+        }
+    }
+    // BR,<N>,<rate>,<start us>,<overruns>, then N int16 samples and N uint32
+    // sample times in ns, little-endian, then \r\n
+    void send_burst()
+    {
+        char micros_buffer[21];
+        Serial.printf("BR,%d,%lu,%s,%lu\r\n", burst_N, burst_rate, u64_to_char(burst_start_us, micros_buffer), burst_overruns);
+        Serial.write(reinterpret_cast<const uint8_t *>(burst_adc), burst_N * sizeof(burst_adc[0]));
+        Serial.write(reinterpret_cast<const uint8_t *>(burst_time_ns), burst_N * sizeof(burst_time_ns[0]));
+        Serial.print("\r\n");
+    }
+    // Noise spectrum: Welch average of n_avg half-overlapping Hann blocks
+    // taken from one burst capture, so the DAC writers are held off the same
+    // way. Only the bins go to the host.
+    NoiseSpectrum noise_spectrum = NoiseSpectrum();
+    bool measure_noise_spectrum(int n_avg, uint32_t rate_hz)
+    {
+        const int hop = NOISE_FFT_SIZE / 2;
+        int max_avg = BURST_MAX_SAMPLES / hop - 1;
+        if (n_avg < 1)
+        {
+            n_avg = 1;
+        }
+        if (n_avg > max_avg)
+        {
+            n_avg = max_avg;
+        }
+        noise_spectrum.reset();
+        capture_burst((n_avg + 1) * hop, rate_hz);
+        for (int block = 0; (block + 2) * hop <= burst_N; ++block)
+        {
+            noise_spectrum.add_block(&burst_adc[block * hop]);
+        }
+        return noise_spectrum.blocks() == static_cast<uint32_t>(n_avg);
+    }
+    // PS,<rate>,<N>,<blocks>,<sum(w^2) in Q15>,<N/2 + 1 bins of mean |X_k|^2>
+    void send_noise_spectrum()
+    {
+        char bin_buffer[21];
+        Serial.printf("PS,%lu,%d,%lu,%lu", burst_rate, NOISE_FFT_SIZE, noise_spectrum.blocks(), noise_spectrum.window_power());
+        for (int k = 0; k < NOISE_FFT_BINS; ++k)
+        {
+            Serial.print(",");
+            Serial.print(u64_to_char(noise_spectrum.bin(k), bin_buffer));
+        }
+        Serial.print("\r\n");
+    }
     // Specify the links and initial tuning parameters
     // Constant current mode
     bool is_const_current = false;
@@ -284,92 +1004,487 @@ public: // Access specifier
     double adc_set_value_log, adc_real_value_log, dac_z_control_value;
 
     // PID current_pid = PID(&adc_real_value_log_log, &dac_z_control_value, &adc_set_value_log_log, INIT_KP, INIT_KI, INIT_KD, DIRECT);
+    // Gains are per update, on the log current. The derivative acts on the
+    // measurement through a one-pole low pass; the integrator is bled back
+    // by pid_tracking times what the Z clamp cuts off the output.
     double Kp = 0.0, Ki = 0.0, Kd = 0.0;
-    double pTerm, iTerm;
+    double pTerm = 0.0, iTerm = 0.0, dTerm = 0.0;
+    double pid_derivative_pole = PID_DERIVATIVE_POLE;
+    double pid_tracking = PID_TRACKING_GAIN;
+    // New gains take over from the present Z without a step
+    void set_pid(double kp, double ki, double kd)
+    {
+        bool in_isr = _feedback_timer_running;
+        _stop_feedback_timer();
+        Kp = kp;
+        Ki = ki;
+        Kd = kd;
+        _fixed_pid.set_gains(kp, ki, kd);
+        if (stm_status.is_const_current)
+        {
+            _engage_pid();
+        }
+        if (in_isr)
+        {
+            _start_feedback_timer();
+        }
+    }
+    void set_pid_filter(double pole, double tracking)
+    {
+        bool in_isr = _feedback_timer_running;
+        _stop_feedback_timer();
+        pid_derivative_pole = clamp_value(pole, 0.0, 0.99);
+        pid_tracking = clamp_value(tracking, 0.0, 1.0);
+        _fixed_pid.set_filter(pid_derivative_pole, pid_tracking);
+        if (in_isr)
+        {
+            _start_feedback_timer();
+        }
+    }
+    // Z loop rate in Hz. Above zero the loop runs in a PIT interrupt on the
+    // newest decimated sample, whatever the main thread is doing;
+    // control_current() then only returns the loop's latest error. A tick
+    // with no new decimated sample since the last one does nothing, so rates
+    // above sample_rate / decimation gain nothing. Zero runs the loop from
+    // the callers as before.
+    uint32_t feedback_rate = 0;
+    void set_feedback_rate(uint32_t rate_hz)
+    {
+        _stop_feedback_timer();
+        if (rate_hz > 0)
+        {
+            rate_hz = rate_hz < FEEDBACK_MIN_HZ ? FEEDBACK_MIN_HZ : rate_hz > FEEDBACK_MAX_HZ ? FEEDBACK_MAX_HZ : rate_hz;
+        }
+        feedback_rate = rate_hz;
+        if (stm_status.is_const_current)
+        {
+            _start_feedback_timer();
+        }
+    }
+    bool feedback_in_isr()
+    {
+        return _feedback_timer_running;
+    }
     void turn_on_const_current(int target_adc)
     {
+        _stop_feedback_timer();
         this->adc_set_value = target_adc;
-        this->adc_set_value_log = static_cast<double>(logTable[abs(target_adc)]);
+        this->adc_set_value_log = static_cast<double>(FastLog::current(target_adc));
         this->dac_z_control_value = static_cast<double>(stm_status.dac_z);
-        pTerm = 0.0;
-        iTerm = 0.0;
+        _engage_pid(); // Start from the present Z
+        _feedback_filter.reset();
         this->stm_status.is_const_current = true;
+        _start_feedback_timer();
     }
+    // Build with -D STM_FIXED_POINT_PID for the integer controller
     int control_current(int adc_value)
     {
-        this->adc_real_value_log = static_cast<double>(logTable[abs(adc_value)]);
-        double error = this->adc_set_value_log - this->adc_real_value_log;
-        pTerm = Kp * error;
-        iTerm += Ki * error;
-        iTerm = clamp_value(iTerm, -32768, 32768);
-        int z = static_cast<int>(pTerm + iTerm) + 32768;
-        if (z > 50000)
+        if (_feedback_timer_running)
         {
-            z = 50000;
+            return _feedback_error; // The interrupt owns the loop
         }
-        if (z < 10000)
-        {
-            z = 10000;
-        }
-        this->set_dac_z(z);
-        return static_cast<int>(error);
+        return _control_update(adc_value, _adc_cycles);
     }
     void turn_off_const_current()
     {
         this->stm_status.is_const_current = false;
+        _stop_feedback_timer();
+    }
+    int _control_update(int adc_value, uint32_t sample_cycles)
+    {
+        adc_value = _feedback_filter.push(adc_value);
+#ifdef STM_FIXED_POINT_PID
+        int32_t setpoint = FastLog::current(adc_set_value);
+        int32_t measurement = FastLog::current(adc_value);
+        int32_t error = setpoint - measurement;
+        int z = _fixed_pid.update(setpoint, measurement) + FEEDBACK_Z_MID;
+#else
+        double error;
+        int z = _pid_double(adc_value, error) + FEEDBACK_Z_MID;
+#endif
+        this->set_dac_z(z);
+        stm_status.latency_ns = CycleClock::to_nanos(CycleClock::now() - sample_cycles);
+        return static_cast<int>(error);
+    }
+    // Cycles per controller update of the double and the integer PID on the
+    // same samples, without the DAC write. Replies PB,<double>,<fixed>,<build>
+    // where build is 1 for a STM_FIXED_POINT_PID firmware. The controllers
+    // take over again from the present Z afterwards.
+    void benchmark_pid(int n)
+    {
+        bool in_isr = _feedback_timer_running;
+        _stop_feedback_timer();
+        volatile int32_t sink = 0;
+        double error;
+        uint32_t start = CycleClock::now();
+        for (int i = 0; i < n; ++i)
+        {
+            sink = _pid_double(static_cast<int16_t>(i * 7919), error);
+        }
+        uint32_t double_cycles = CycleClock::now() - start;
+        start = CycleClock::now();
+        for (int i = 0; i < n; ++i)
+        {
+            int16_t adc_value = static_cast<int16_t>(i * 7919);
+            sink = _fixed_pid.update(FastLog::current(adc_set_value), FastLog::current(adc_value));
+        }
+        uint32_t fixed_cycles = CycleClock::now() - start;
+        (void)sink;
+        _engage_pid();
+        if (in_isr)
+        {
+            _start_feedback_timer();
+        }
+#ifdef STM_FIXED_POINT_PID
+        int build = 1;
+#else
+        int build = 0;
+#endif
+        Serial.printf("PB,%lu,%lu,%d\r\n", n > 0 ? double_cycles / n : 0, n > 0 ? fixed_cycles / n : 0, build);
+    }
+    // Relay (Astrom-Hagglund) auto-tune around the present set point and Z.
+    // Z is switched to z0 + amplitude while the current is below the set
+    // point by more than the hysteresis and to z0 - amplitude while it is
+    // above, the same sense as the controller. After the oscillation settles
+    // the relay period gives Tu and the log-current peak-to-peak a gives
+    //
+    //     Ku = 4 * amplitude / (pi * sqrt(a^2 - hysteresis^2))
+    //
+    // Ziegler-Nichols PI (rule 0) or PID (rule 1) gains follow, converted to
+    // per-update gains at the rate the loop runs. Replies
+    // AT,<ok>,<Ku>,<Tu us>,<Kp>,<Ki>,<Kd> and with apply takes the gains
+    // over bumplessly. Z goes back to z0 and the loop resumes; an
+    // overcurrent retract aborts and leaves Z retracted.
+    bool autotune_current(int amplitude, int hysteresis, bool apply, int rule)
+    {
+        if (!stm_status.is_const_current || check_fault())
+        {
+            Serial.printf("AT,0,0,0,0,0,0\r\n");
+            return false;
+        }
+        amplitude = amplitude > 0 ? amplitude : AUTOTUNE_DEFAULT_AMPLITUDE;
+        double h = hysteresis > 0 ? hysteresis : AUTOTUNE_DEFAULT_HYSTERESIS;
+        bool in_isr = _feedback_timer_running;
+        _stop_feedback_timer();
+        int z0 = stm_status.dac_z;
+        int high = min(z0 + amplitude, FEEDBACK_Z_MAX);
+        int low = max(z0 - amplitude, FEEDBACK_Z_MIN);
+        _feedback_filter.reset();
+        bool up = true;
+        set_dac_z(high);
+        uint64_t start_us = CycleClock::micros64();
+        uint64_t last_up_us = 0;
+        uint64_t period_sum_us = 0;
+        double swing_sum = 0.0;
+        double y_low = 0.0;
+        double y_high = 0.0;
+        int periods = 0;
+        bool ok = true;
+        while (periods < AUTOTUNE_SETTLE_PERIODS + AUTOTUNE_PERIODS)
+        {
+            if (check_fault())
+            {
+                Serial.printf("AT,0,0,0,0,0,0\r\n");
+                return false; // Retracted, constant current is off
+            }
+            if (CycleClock::micros64() - start_us > AUTOTUNE_TIMEOUT_US)
+            {
+                ok = false; // No sustained oscillation
+                break;
+            }
+            double y = FastLog::current(read_adc_feedback());
+            uint64_t now_us = sample_micros();
+            y_low = min(y_low, y);
+            y_high = max(y_high, y);
+            double error = adc_set_value_log - y;
+            if (!up && error > h)
+            {
+                up = true;
+                set_dac_z(high);
+                if (last_up_us > 0 && ++periods > AUTOTUNE_SETTLE_PERIODS)
+                {
+                    period_sum_us += now_us - last_up_us;
+                    swing_sum += y_high - y_low;
+                }
+                last_up_us = now_us;
+                y_low = y;
+                y_high = y;
+            }
+            else if (up && error < -h)
+            {
+                up = false;
+                set_dac_z(low);
+            }
+        }
+        double ku = 0.0;
+        double tu_us = 0.0;
+        double kp = 0.0, ki = 0.0, kd = 0.0;
+        double a = swing_sum / (2.0 * AUTOTUNE_PERIODS);
+        if (ok && a > h)
+        {
+            ku = 4.0 * (high - low) / 2.0 / (PI * sqrt(a * a - h * h));
+            tu_us = static_cast<double>(period_sum_us) / AUTOTUNE_PERIODS;
+            // Period of one controller update
+            uint32_t rate_hz = stm_status.sample_rate > 0 ? stm_status.sample_rate : sample_clock.rate_hz();
+            double ts_us = feedback_rate > 0 ? 1e6 / min(feedback_rate, rate_hz) : 1e6 * decimator.decimation() / rate_hz;
+            if (rule == 1)
+            {
+                kp = 0.6 * ku;
+                ki = kp * ts_us / (tu_us / 2.0);
+                kd = kp * (tu_us / 8.0) / ts_us;
+            }
+            else
+            {
+                kp = 0.45 * ku;
+                ki = kp * ts_us / (tu_us / 1.2);
+            }
+        }
+        else
+        {
+            ok = false;
+        }
+        set_dac_z(z0);
+        if (ok && apply)
+        {
+            set_pid(kp, ki, kd); // Engages from z0
+        }
+        else
+        {
+            _engage_pid();
+        }
+        if (in_isr)
+        {
+            _start_feedback_timer();
+        }
+        Serial.printf("AT,%d,%g,%g,%g,%g,%g\r\n", ok, ku, tu_us, kp, ki, kd);
+        return ok;
+    }
+    // Cycles per call of FastLog::current(), of the old logTable lookup and
+    // of the libm formula, on scattered inputs as the feedback loop sees
+    // them. Replies LB,<fast>,<table>,<libm>,<fast bytes>,<table bytes>,<max error>
+    // where the error is checked over every input against the formula. The
+    // table fields are 0 unless built with -D STM_LOG_TABLE_BENCHMARK.
+    void benchmark_log(int n)
+    {
+        volatile int32_t sink = 0;
+        const double scale = 524287.0 / log(32769.0);
+        uint32_t start = CycleClock::now();
+        for (int i = 0; i < n; ++i)
+        {
+            sink = FastLog::current(static_cast<int16_t>(i * 7919));
+        }
+        uint32_t fast_cycles = CycleClock::now() - start;
+        uint32_t table_cycles = 0;
+        uint32_t table_bytes = 0;
+#ifdef STM_LOG_TABLE_BENCHMARK
+        start = CycleClock::now();
+        for (int i = 0; i < n; ++i)
+        {
+            sink = logTable[abs(static_cast<int16_t>(i * 7919))];
+        }
+        table_cycles = CycleClock::now() - start;
+        table_bytes = sizeof(logTable);
+#endif
+        start = CycleClock::now();
+        for (int i = 0; i < n; ++i)
+        {
+            int x = abs(static_cast<int16_t>(i * 7919));
+            sink = static_cast<int32_t>(lround(log(max(x, 1) + 1.0) * scale));
+        }
+        uint32_t libm_cycles = CycleClock::now() - start;
+        (void)sink;
+        int32_t max_error = 0;
+        for (int x = 0; x <= FAST_LOG_MAX_INPUT; ++x)
+        {
+            int32_t exact = static_cast<int32_t>(lround(log(max(x, 1) + 1.0) * scale));
+            max_error = max(max_error, abs(FastLog::current(x) - exact));
+        }
+        Serial.printf("LB,%lu,%lu,%lu,%lu,%lu,%ld\r\n", n > 0 ? fast_cycles / n : 0, n > 0 ? table_cycles / n : 0,
+                      n > 0 ? libm_cycles / n : 0, FastLog::footprint(), table_bytes, max_error);
     }
     // Scan Control
-    int scan_image_z[2048];
-    int scan_image_adc[2048];
+    int scan_image[SCAN_CHANNELS][SCAN_MAX_PIXELS];
+    int scan_pixel_time[SCAN_MAX_PIXELS]; // Microseconds from the first sample of the line to the last sample of each pixel
+    uint32_t scan_channels = SCAN_DEFAULT_CHANNELS;
+    uint32_t scan_line_rate = 0; // Fast-axis points per second from the waveform player, 0 for CPU-paced lines
+    void set_scan_channels(uint32_t mask)
+    {
+        scan_channels = mask & ((1 << SCAN_CHANNELS) - 1);
+    }
 
+    void set_scan_line_rate(uint32_t rate_hz)
+    {
+        scan_line_rate = rate_hz == 0 ? 0 : WaveformPlayer::clamp_rate(rate_hz);
+    }
     void start_scan(int x_start, int x_end, int x_resolution, int y_start, int y_end, int y_resolution, int sample_per_pixel)
     {
+        sample_per_pixel = constrain(sample_per_pixel, 1, PIXEL_STATS_MAX_SAMPLES);
         move_to(x_start, y_start);
         double x_step = 1.0f * (x_end - x_start) / x_resolution;
         double y_step = 1.0f * (y_end - y_start) / y_resolution / sample_per_pixel;
+        // Trace and retrace share one table
+        bool played = scan_line_rate > 0 && 2 * y_resolution * sample_per_pixel <= WAVEFORM_MAX_POINTS;
         for (int x_i = 0; x_i < x_resolution; ++x_i)
         {
             int x_now = static_cast<int>(x_start + x_i * x_step);
-            set_dac_x(x_now);
-            int sample_count = 0;
-            int err_sum = 0;
-            int dacz_sum = 0;
+            uint64_t line_start_us = 0;
+            if (played)
+            {
+                set_dac_x(x_now);
+                _scan_line_waveform(x_now, y_start, y_step, y_resolution, sample_per_pixel, line_start_us);
+                if (check_fault())
+                {
+                    break;
+                }
+                _send_scan_line_data(x_i, line_start_us, y_resolution);
+                continue;
+            }
+            stage_dac_x(x_now);
+            PixelStats adc_stats = PixelStats();
+            PixelStats z_stats = PixelStats();
             for (int y_i = 0; y_i < y_resolution * sample_per_pixel; ++y_i)
             {
                 int y_now = static_cast<int>(y_start + y_i * y_step);
-                set_dac_y(y_now);
-                int adc_value = read_adc_raw();
+                stage_dac_y(y_now);
+                commit_dacs(); // X and Y together on the first pixel of a line
+                int adc_value = read_adc_decimated();
+                if (y_i == 0)
+                {
+                    line_start_us = sample_micros();
+                }
                 if (this->stm_status.is_const_current)
                 {
 
                     adc_value = control_current(adc_value);
                 }
-                err_sum += adc_value;
-                dacz_sum += stm_status.dac_z;
-                sample_count++;
-                if (sample_count == sample_per_pixel)
+                adc_stats.add(adc_value);
+                z_stats.add(stm_status.dac_z);
+                if (adc_stats.count() == static_cast<uint32_t>(sample_per_pixel))
                 {
-                    scan_image_adc[y_i / sample_per_pixel] = err_sum / sample_per_pixel;
-                    scan_image_z[y_i / sample_per_pixel] = dacz_sum / sample_per_pixel;
-                    sample_count = 0;
-                    err_sum = 0;
-                    dacz_sum = 0;
+                    _store_pixel(y_i / sample_per_pixel, adc_stats, z_stats, line_start_us);
                 }
             }
-            send_scan_line("A", x_i, scan_image_adc, y_resolution);
-            send_scan_line("Z", x_i, scan_image_z, y_resolution);
+            if (check_fault())
+            {
+                break;
+            }
+            _send_scan_line_data(x_i, line_start_us, y_resolution);
             for (int y_i = y_resolution * sample_per_pixel - 1; y_i >= 0; --y_i)
             {
                 int y_now = static_cast<int>(y_start + y_i * y_step);
                 set_dac_y(y_now);
                 if (this->stm_status.is_const_current)
                 {
-                    control_current(read_adc_raw());
+                    control_current(read_adc_decimated());
                 }
             }
         }
         Serial.println("D");
     }
+    // One line played by the waveform player, trace then retrace. The ADC
+    // samples are binned by the table point the DACs held when each sample
+    // was read, so a pixel holds every sample taken while it was addressed.
+    void _scan_line_waveform(int x_now, int y_start, double y_step, int y_resolution, int sample_per_pixel, uint64_t &line_start_us)
+    {
+        int points = y_resolution * sample_per_pixel;
+        waveform.clear();
+        // Copies of the compensators run ahead over the times the points will
+        // be played. They replace the live ones only once the line has played.
+        PiezoCompensator played_x = piezo_x;
+        PiezoCompensator played_y = piezo_y;
+        uint32_t period_us = 1000000UL / scan_line_rate;
+        uint32_t point_us = micros() + period_us;
+        for (int y_i = 0; y_i < points; ++y_i, point_us += period_us)
+        {
+            int y_now = static_cast<int>(y_start + y_i * y_step);
+            waveform.append(played_x.apply(x_now, point_us), played_y.apply(y_now, point_us));
+        }
+        for (int y_i = points - 1; y_i >= 0; --y_i, point_us += period_us)
+        {
+            int y_now = static_cast<int>(y_start + y_i * y_step);
+            waveform.append(played_x.apply(x_now, point_us), played_y.apply(y_now, point_us));
+        }
+        PixelStats adc_stats = PixelStats();
+        PixelStats z_stats = PixelStats();
+        int pixel = 0;
+        play_waveform(scan_line_rate, 1);
+        while (waveform.running())
+        {
+            int adc_value = read_adc_decimated();
+            int point = static_cast<int>(waveform.position()) - 1;
+            if (this->stm_status.is_const_current)
+            {
+                adc_value = control_current(adc_value);
+            }
+            if (check_fault())
+            {
+                stop_waveform();
+                return;
+            }
+            if (point < 0 || point >= points)
+            {
+                continue; // Not started yet, or on the retrace
+            }
+            if (pixel == 0 && adc_stats.count() == 0)
+            {
+                line_start_us = sample_micros();
+            }
+            for (int now = point / sample_per_pixel; pixel < now; ++pixel)
+            {
+                _store_pixel(pixel, adc_stats, z_stats, line_start_us);
+            }
+            if (adc_stats.count() < PIXEL_STATS_MAX_SAMPLES)
+            {
+                adc_stats.add(adc_value); // A slow line can sample a pixel more often than the stats allow
+                z_stats.add(stm_status.dac_z);
+            }
+        }
+        for (; pixel < y_resolution; ++pixel)
+        {
+            _store_pixel(pixel, adc_stats, z_stats, line_start_us);
+        }
+        piezo_x = played_x;
+        piezo_y = played_y;
+        _sync_waveform();
+        stm_status.dac_x = x_now; // The table held compensated codes, keep the targets
+        stm_status.dac_y = y_start;
+    }
+    // Pixel values from the stats, which are then reset. A pixel the line
+    // passed without a sample repeats the one before it.
+    void _store_pixel(int pixel, PixelStats &adc_stats, PixelStats &z_stats, uint64_t line_start_us)
+    {
+        if (adc_stats.count() == 0)
+        {
+            for (int channel = 0; channel < SCAN_CHANNELS; ++channel)
+            {
+                scan_image[channel][pixel] = pixel > 0 ? scan_image[channel][pixel - 1] : 0;
+            }
+            scan_pixel_time[pixel] = pixel > 0 ? scan_pixel_time[pixel - 1] : 0;
+            return;
+        }
+        scan_image[SCAN_ADC_MEAN][pixel] = adc_stats.mean();
+        scan_image[SCAN_Z_MEAN][pixel] = z_stats.mean();
+        scan_image[SCAN_ADC_VAR][pixel] = adc_stats.variance();
+        scan_image[SCAN_ADC_MIN][pixel] = adc_stats.min();
+        scan_image[SCAN_ADC_MAX][pixel] = adc_stats.max();
+        scan_image[SCAN_Z_VAR][pixel] = z_stats.variance();
+        scan_image[SCAN_Z_MIN][pixel] = z_stats.min();
+        scan_image[SCAN_Z_MAX][pixel] = z_stats.max();
+        scan_pixel_time[pixel] = static_cast<int>(sample_micros() - line_start_us);
+        adc_stats.reset();
+        z_stats.reset();
+    }
+    void _send_scan_line_data(int x_i, uint64_t line_start_us, int y_resolution)
+    {
+        for (int channel = 0; channel < SCAN_CHANNELS; ++channel)
+        {
+            if (scan_channels & (1 << channel))
+            {
+                send_scan_line(SCAN_CHANNEL_PREFIX[channel], x_i, scan_image[channel], y_resolution);
+            }
+        }
+        send_scan_times(x_i, line_start_us, scan_pixel_time, y_resolution);
+    }
     void send_scan_line(String prefix, int x_i, int *data, int num_points)
     {
         Serial.print(prefix);
@@ -382,52 +1497,54 @@ public: // Access specifier
         }
         Serial.print("\r\n");
     }
-    void move_to(int target_x, int target_y)
+    // T,<x_i>,<line start in us>,<pixel times relative to the line start>
+    void send_scan_times(int x_i, uint64_t line_start_us, int *data, int num_points)
     {
-        while (target_x != stm_status.dac_x)
+        char micros_buffer[21];
+        Serial.printf("T,%d,%s", x_i, u64_to_char(line_start_us, micros_buffer));
+        for (int i = 0; i < num_points; ++i)
         {
-            if (stm_status.is_const_current)
-            {
-                control_current(read_adc_raw());
-            }
-            if (abs(target_x - stm_status.dac_x) < MOVE_SPEED)
-            {
-                set_dac_x(target_x);
-            }
-            else
-            {
-                if (target_x > stm_status.dac_x)
-                {
-                    set_dac_x(stm_status.dac_x + MOVE_SPEED);
-                }
-                else
-                {
-                    set_dac_x(stm_status.dac_x - MOVE_SPEED);
-                }
-            }
+            Serial.print(",");
+            Serial.print(data[i]);
         }
-        while (target_y != stm_status.dac_y)
+        Serial.print("\r\n");
+    }
+    // Coordinated X/Y move on the planner's trapezoidal profile. Every step
+    // waits for the next ADC sample, sets the position for that sample's
+    // conversion time and runs the Z feedback on the same sample. With
+    // report set, the expected duration goes out first as MV,<us>.
+    TrajectoryPlanner planner = TrajectoryPlanner();
+    uint32_t move_to(int target_x, int target_y, bool report = false)
+    {
+        uint32_t duration_us = planner.plan(stm_status.dac_x, stm_status.dac_y, target_x, target_y);
+        if (report)
         {
-            if (stm_status.is_const_current)
-            {
-                control_current(read_adc_raw());
-            }
-            if (abs(target_y - stm_status.dac_y) < MOVE_SPEED)
+            Serial.printf("MV,%lu\r\n", duration_us);
+        }
+        read_adc_decimated();
+        uint64_t start_us = sample_micros();
+        uint64_t deadline_us = CycleClock::micros64() + duration_us + MOVE_STALL_US;
+        int x = stm_status.dac_x;
+        int y = stm_status.dac_y;
+        bool moving = true;
+        while (moving)
+        {
+            int adc_value = read_adc_decimated();
+            uint64_t elapsed_us = sample_micros() - start_us;
+            if (CycleClock::micros64() > deadline_us)
             {
-                set_dac_y(target_y);
+                elapsed_us = duration_us; // ADC stalled, finish the move
             }
-            else
+            moving = planner.position_at(static_cast<uint32_t>(min(elapsed_us, static_cast<uint64_t>(duration_us))), x, y);
+            stage_dac_x(x);
+            stage_dac_y(y);
+            commit_dacs();
+            if (stm_status.is_const_current)
             {
-                if (target_y > stm_status.dac_y)
-                {
-                    set_dac_y(stm_status.dac_y + MOVE_SPEED);
-                }
-                else
-                {
-                    set_dac_y(stm_status.dac_y - MOVE_SPEED);
-                }
+                control_current(adc_value);
             }
         }
+        return duration_us;
     }
 
     // Piezo
@@ -458,32 +1575,275 @@ public: // Access specifier
         }
     }
     STMStatus stm_status = STMStatus();
+    SampleClock sample_clock = SampleClock();
+    AdcStream adc_stream = AdcStream(&_adc_dma);
 
 private:
     // DAC Settings
-    AD5761 dac_x = AD5761(DAC_1, 0b0000000000000101);    // Output range: -5 to 5V
-    AD5761 dac_y = AD5761(DAC_2, 0b0000000000000101);    // Output range: -5 to 5V
-    AD5761 dac_z = AD5761(DAC_3, 0b0000000000000000);    // Output range: -10 to 10V
-    AD5761 dac_bias = AD5761(DAC_4, 0b0000000000000101); // Output range: -3 to 3V
+#ifdef DAC_DAISY_CHAIN
+    Spi0FrameBus _dac_bus = Spi0FrameBus(DAC_1);
+    AD5761Chain _dac_chain = AD5761Chain(&_dac_bus);
+    AD5761 dac_x = AD5761(&_dac_chain, DAC_CHAIN_POS_X, DAC_MODE_X);          // Output range: -3 to 3V
+    AD5761 dac_y = AD5761(&_dac_chain, DAC_CHAIN_POS_Y, DAC_MODE_Y);          // Output range: -3 to 3V
+    AD5761 dac_z = AD5761(&_dac_chain, DAC_CHAIN_POS_Z, DAC_MODE_Z);          // Output range: -10 to 10V
+    AD5761 dac_bias = AD5761(&_dac_chain, DAC_CHAIN_POS_BIAS, DAC_MODE_BIAS); // Output range: -3 to 3V
+#else
+    AD5761 dac_x = AD5761(DAC_1, DAC_MODE_X);       // Output range: -3 to 3V
+    AD5761 dac_y = AD5761(DAC_2, DAC_MODE_Y);       // Output range: -3 to 3V
+    AD5761 dac_z = AD5761(DAC_3, DAC_MODE_Z);       // Output range: -10 to 10V
+    AD5761 dac_bias = AD5761(DAC_4, DAC_MODE_BIAS); // Output range: -3 to 3V
+#endif
 
     // ADC settings
     LTC2326_16 ltc2326 = LTC2326_16(CS_ADC, CNV, BUSY);
+    Ltc2326DmaBackend _adc_dma = Ltc2326DmaBackend(CS_ADC, CNV, &sample_clock);
+    void _begin_acquisition()
+    {
+        SPI.usingInterrupt(IRQ_GPIO6789); // BUSY pin interrupt, it may write the Z DAC
+        ltc2326.begin_interrupt();
+        sample_clock.begin(LTC2326_16::convert_isr, sample_clock.rate_hz());
+    }
+
+    SigmaDeltaDac _position_x = SigmaDeltaDac(&dac_x);
+    SigmaDeltaDac _position_y = SigmaDeltaDac(&dac_y);
+    SigmaDeltaDac _position_z = SigmaDeltaDac(&dac_z);
+
+    DacCalibration _calibration[DAC_CHANNELS];
+
+    int _staged[DAC_CHANNELS];
+    uint32_t _staged_mask = 0;
+    void _stage(int channel, int value)
+    {
+        _staged[channel] = value;
+        _staged_mask |= 1 << channel;
+    }
+    AD5761 &_dac(int channel)
+    {
+        switch (channel)
+        {
+        case DAC_CH_X:
+            return dac_x;
+        case DAC_CH_Y:
+            return dac_y;
+        case DAC_CH_Z:
+            return dac_z;
+        default:
+            return dac_bias;
+        }
+    }
+    int &_status_code(int channel)
+    {
+        switch (channel)
+        {
+        case DAC_CH_X:
+            return stm_status.dac_x;
+        case DAC_CH_Y:
+            return stm_status.dac_y;
+        case DAC_CH_Z:
+            return stm_status.dac_z;
+        default:
+            return stm_status.bias;
+        }
+    }
+    bool _waveform_active = false;
+    // Copy the codes the player wrote into stm_status
+    void _sync_waveform()
+    {
+        if (!_waveform_active)
+        {
+            return;
+        }
+        stm_status.dac_x = waveform.x();
+        stm_status.dac_y = waveform.y();
+        stm_status.time_millis = millis();
+        _waveform_active = waveform.running();
+    }
+    void _release_waveform()
+    {
+        if (_waveform_active)
+        {
+            stop_waveform();
+        }
+    }
+    FixedPidController _fixed_pid;
+
+    // Interrupt-driven Z loop
+    IntervalTimer _feedback_timer;
+    volatile bool _feedback_timer_running = false;
+    volatile int _feedback_error = 0;
+    uint32_t _feedback_seq = 0; // Decimated output count of the last update
+    static STM *_feedback_owner;
+    void _start_feedback_timer()
+    {
+        if (feedback_rate == 0 || _feedback_timer_running)
+        {
+            return;
+        }
+        _feedback_owner = this;
+        SPI.usingInterrupt(IRQ_PIT); // The loop writes Z from a PIT interrupt
+        feedback_input.enabled = false;
+        feedback_input.decimator.set_decimation(decimator.decimation());
+        feedback_input.decimator.set_compensation(decimator.compensation());
+        feedback_input.decimator.reset();
+        _feedback_seq = feedback_input.outputs;
+        feedback_input.enabled = true;
+        _feedback_timer_running = _feedback_timer.begin(_feedback_isr, 1000000.0f / feedback_rate);
+    }
+    void _stop_feedback_timer()
+    {
+        _feedback_timer.end();
+        _feedback_timer_running = false;
+        feedback_input.enabled = false;
+    }
+    // One loop update per tick, on the newest decimated sample if one was
+    // produced since the last tick. The loop stops itself when constant
+    // current ends or the overcurrent guard retracts.
+    static void _feedback_isr()
+    {
+        STM *self = _feedback_owner;
+        if (!self->stm_status.is_const_current || OvercurrentGuard::retracted())
+        {
+            self->_feedback_timer.end();
+            self->_feedback_timer_running = false;
+            feedback_input.enabled = false;
+            return;
+        }
+        uint32_t count;
+        int32_t value = feedback_input.latest(count);
+        if (count == self->_feedback_seq)
+        {
+            return;
+        }
+        self->_feedback_seq = count;
+        // Latency from the newest conversion, the last one into the decimator or later
+        uint32_t seq;
+        uint32_t cycles;
+        if (self->adc_stream.running())
+        {
+            self->adc_stream.latest(seq, cycles);
+        }
+        else
+        {
+            self->ltc2326.latest(seq, cycles);
+        }
+        self->_feedback_error = self->_control_update(value, cycles);
+    }
+    // The double-precision PID, returns the clamped Z offset from mid-scale
+    // and the error. Matches FixedPidController::update().
+    double _pid_last_log = 0.0;
+    double _pid_engage_output = 0.0;
+    double _pid_integral_limit = FIXED_PID_INTEGRAL_LIMIT;
+    bool _pid_engage = true;
+    int _pid_double(int adc_value, double &error)
+    {
+        this->adc_real_value_log = static_cast<double>(FastLog::current(adc_value));
+        error = this->adc_set_value_log - this->adc_real_value_log;
+        pTerm = Kp * error;
+        if (_pid_engage)
+        {
+            _pid_last_log = adc_real_value_log;
+            dTerm = 0.0;
+        }
+        double slope = clamp_value(Kd * (_pid_last_log - adc_real_value_log), -65536, 65536);
+        dTerm += (slope - dTerm) * (1.0 - pid_derivative_pole);
+        _pid_last_log = adc_real_value_log;
+        if (_pid_engage)
+        {
+            iTerm = _pid_engage_output - pTerm - dTerm;
+            _pid_integral_limit = fabs(iTerm);
+            _pid_engage = false;
+        }
+        else
+        {
+            iTerm += Ki * error;
+        }
+        _pid_integral_limit = max(static_cast<double>(FIXED_PID_INTEGRAL_LIMIT), min(_pid_integral_limit, fabs(iTerm)));
+        iTerm = clamp_value(iTerm, -_pid_integral_limit, _pid_integral_limit);
+        double output = pTerm + iTerm + dTerm;
+        double clamped = clamp_value(output, FEEDBACK_Z_MIN - FEEDBACK_Z_MID, FEEDBACK_Z_MAX - FEEDBACK_Z_MID);
+        iTerm = clamp_value(iTerm + pid_tracking * (clamped - output), -_pid_integral_limit, _pid_integral_limit);
+        return static_cast<int>(clamped);
+    }
+    // Both controllers hold the present Z on their next update
+    void _engage_pid()
+    {
+        int output = stm_status.dac_z - FEEDBACK_Z_MID;
+        _pid_engage_output = output;
+        _pid_engage = true;
+        _fixed_pid.engage(output);
+    }
+    // Code sent for a target code, after the piezo compensation of X and Y
+    uint16_t _output_code(int channel, int value)
+    {
+        switch (channel)
+        {
+        case DAC_CH_X:
+            return piezo_x.apply(value, micros());
+        case DAC_CH_Y:
+            return piezo_y.apply(value, micros());
+        default:
+            return value;
+        }
+    }
+    // Re-apply the compensation to the held targets so creep stays corrected
+    void _hold_piezo()
+    {
+        if (_waveform_active)
+        {
+            return;
+        }
+        if (piezo_x.enabled() && !_position_x.dithering())
+        {
+            dac_x.write_code(_output_code(DAC_CH_X, stm_status.dac_x));
+        }
+        if (piezo_y.enabled() && !_position_y.dithering())
+        {
+            dac_y.write_code(_output_code(DAC_CH_Y, stm_status.dac_y));
+        }
+    }
+    uint32_t _updates_per_second(int n, uint32_t cycles)
+    {
+        return cycles == 0 ? 0 : static_cast<uint32_t>(static_cast<uint64_t>(n) * F_CPU_ACTUAL / cycles);
+    }
 
-    int _adc_buffer[5];
-    int _current_index = 0;
-    int _adc_sum = 0;
-    void _add_adc_value(int value)
+    uint32_t _adc_seq = 0;
+    uint32_t _adc_cycles = 0; // CNV cycle count of the last sample read
+    int32_t _adc_decimated = 0;
+    uint32_t _decimated_seq = 0; // Last BUSY-path conversion pushed into the decimator
+    // Decimator input on the BUSY path, where only the newest conversion is
+    // kept: a jump in the sequence number means conversions were missed.
+    bool _decimate_busy(int16_t val, int32_t &out)
     {
-        _current_index += 1;
-        _current_index = _current_index % 5;
-        _adc_sum -= _adc_buffer[_current_index];
-        _adc_buffer[_current_index] = value;
-        _adc_sum += _adc_buffer[_current_index];
+        if (_adc_seq - _decimated_seq != 1)
+        {
+            decimator.reset();
+        }
+        _decimated_seq = _adc_seq;
+        return decimator.push(val, out);
     }
-    int _get_adc_avg()
+    // Next conversion in order, for filters that must see every sample
+    bool _next_sample(int16_t &val)
     {
-        return static_cast<int>(_adc_sum / 5.0);
+        if (adc_stream.running())
+        {
+            uint32_t timeout_us = adc_timeout_us();
+            uint32_t start_time = micros();
+            while (!adc_stream.pop(val, _adc_cycles))
+            {
+                if (micros() - start_time > timeout_us)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        return ltc2326.wait_next(_adc_seq, val, _adc_cycles, adc_timeout_us());
     }
+    StatusAdcFilter _status_filter = StatusAdcFilter();
+    FeedbackAdcFilter _feedback_filter = FeedbackAdcFilter();
+    SpectroscopyAdcFilter _spectroscopy_filter = SpectroscopyAdcFilter();
 };
 
+STM *STM::_feedback_owner = nullptr;
+
 #endif // STM_FIRMWARE_H
\ No newline at end of file
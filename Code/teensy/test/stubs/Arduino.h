@@ -0,0 +1,44 @@
+/**************************************************************************/
+/*
+
+Host stand-in for the few parts of the Arduino core that the host-testable
+libraries use. Only the native test environment puts this directory on the
+include path.
+
+micros() moves on by one on every call, so a timeout in the code under test
+runs out after a known number of polls instead of hanging the test.
+
+*/
+/**************************************************************************/
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+typedef uint8_t byte;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+inline uint32_t micros()
+{
+    static uint32_t now = 0;
+    return ++now;
+}
+inline uint32_t millis() { return micros() / 1000; }
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline void digitalWriteFast(uint8_t, uint8_t) {}
+
+using std::max;
+using std::min;
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,40 @@
+/**************************************************************************/
+/*
+
+Host stand-in for the Teensy SPI library: enough for the declarations in
+the libraries under test to compile. Nothing is sent; tests that look at
+the bus go through a mocked frame bus instead.
+
+*/
+/**************************************************************************/
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include "Arduino.h"
+
+#define MSBFIRST 1
+#define SPI_MODE0 0x00
+#define SPI_MODE2 0x08
+
+class SPISettings
+{
+public:
+    SPISettings() {}
+    SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass
+{
+public:
+    void begin() {}
+    void beginTransaction(const SPISettings &) {}
+    void endTransaction() {}
+    uint8_t transfer(uint8_t) { return 0; }
+    uint16_t transfer16(uint16_t) { return 0; }
+    void transfer(const void *, void *, size_t) {}
+};
+
+static SPIClass SPI;
+
+#endif // HOST_SPI_H
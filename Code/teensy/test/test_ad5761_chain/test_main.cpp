@@ -0,0 +1,121 @@
+/**************************************************************************/
+/*
+
+AD5761Chain on the host, sending into MockSpiFrameBus.
+
+Run with: pio test -e native
+
+The native environment builds none of lib/, so the chain's source is
+compiled into the test directly.
+
+*/
+/**************************************************************************/
+
+#include <unity.h>
+#include "AD5761Chain.cpp"
+#include "MockSpiFrameBus.hpp"
+
+static MockSpiFrameBus bus;
+static AD5761Chain *chain = nullptr;
+
+void setUp(void)
+{
+    bus.clear();
+    chain = new AD5761Chain(&bus);
+}
+
+void tearDown(void)
+{
+    delete chain;
+}
+
+void test_position_zero_gets_the_last_24_bits(void)
+{
+    chain->write_now(0, CMD_WR_UPDATE_DAC_REG, 0x1234);
+    TEST_ASSERT_EQUAL(1, bus.count());
+    TEST_ASSERT_EQUAL(AD5761_CHAIN_LENGTH * AD5761_FRAME_BYTES, bus.length(0));
+    const uint8_t *frame = bus.frame(0);
+    const int last = (AD5761_CHAIN_LENGTH - 1) * AD5761_FRAME_BYTES;
+    TEST_ASSERT_EQUAL_HEX8(CMD_WR_UPDATE_DAC_REG, frame[last]);
+    TEST_ASSERT_EQUAL_HEX8(0x12, frame[last + 1]);
+    TEST_ASSERT_EQUAL_HEX8(0x34, frame[last + 2]);
+    // The device furthest from the Teensy gets the first word out
+    chain->write_now(AD5761_CHAIN_LENGTH - 1, CMD_WR_UPDATE_DAC_REG, 0xABCD);
+    frame = bus.frame(1);
+    TEST_ASSERT_EQUAL_HEX8(CMD_WR_UPDATE_DAC_REG, frame[0]);
+    TEST_ASSERT_EQUAL_HEX8(0xAB, frame[1]);
+    TEST_ASSERT_EQUAL_HEX8(0xCD, frame[2]);
+}
+
+void test_unused_positions_get_a_nop(void)
+{
+    chain->write_now(2, CMD_WR_UPDATE_DAC_REG, 0x8000);
+    for (int position = 0; position < AD5761_CHAIN_LENGTH; ++position)
+    {
+        if (position == 2)
+        {
+            TEST_ASSERT_EQUAL_HEX8(CMD_WR_UPDATE_DAC_REG, bus.command(0, position));
+            TEST_ASSERT_EQUAL_HEX16(0x8000, bus.data(0, position));
+        }
+        else
+        {
+            TEST_ASSERT_EQUAL_HEX8(CMD_NOP, bus.command(0, position));
+        }
+    }
+}
+
+void test_queue_waits_for_flush_and_sends_one_frame(void)
+{
+    chain->queue(0, CMD_WR_UPDATE_DAC_REG, 100);
+    chain->queue(3, CMD_WR_UPDATE_DAC_REG, 400);
+    TEST_ASSERT_EQUAL(0, bus.count());
+    chain->flush();
+    TEST_ASSERT_EQUAL(1, bus.count());
+    TEST_ASSERT_EQUAL_UINT32(1, chain->frames());
+    TEST_ASSERT_EQUAL_HEX16(100, bus.data(0, 0));
+    TEST_ASSERT_EQUAL_HEX16(400, bus.data(0, 3));
+    TEST_ASSERT_EQUAL_HEX8(CMD_NOP, bus.command(0, 1));
+    TEST_ASSERT_EQUAL_HEX8(CMD_NOP, bus.command(0, 2));
+    chain->flush(); // Nothing queued, nothing sent
+    TEST_ASSERT_EQUAL(1, bus.count());
+}
+
+void test_queueing_a_position_twice_sends_the_first_command(void)
+{
+    chain->queue(1, CMD_WR_TO_INPUT_REG, 10);
+    chain->queue(2, CMD_WR_UPDATE_DAC_REG, 20);
+    chain->queue(1, CMD_UPDATE_DAC_REG, 0);
+    TEST_ASSERT_EQUAL(1, bus.count());
+    TEST_ASSERT_EQUAL_HEX8(CMD_WR_TO_INPUT_REG, bus.command(0, 1));
+    TEST_ASSERT_EQUAL_HEX16(10, bus.data(0, 1));
+    TEST_ASSERT_EQUAL_HEX8(CMD_WR_UPDATE_DAC_REG, bus.command(0, 2));
+    chain->flush();
+    TEST_ASSERT_EQUAL(2, bus.count());
+    TEST_ASSERT_EQUAL_HEX8(CMD_UPDATE_DAC_REG, bus.command(1, 1));
+    TEST_ASSERT_EQUAL_HEX8(CMD_NOP, bus.command(1, 2));
+}
+
+void test_write_now_leaves_the_queue_alone(void)
+{
+    chain->queue(0, CMD_WR_UPDATE_DAC_REG, 111);
+    chain->write_now(1, CMD_WR_UPDATE_DAC_REG, 222);
+    TEST_ASSERT_EQUAL(1, bus.count());
+    TEST_ASSERT_EQUAL_HEX8(CMD_NOP, bus.command(0, 0));
+    TEST_ASSERT_EQUAL_HEX16(222, bus.data(0, 1));
+    chain->flush();
+    TEST_ASSERT_EQUAL(2, bus.count());
+    TEST_ASSERT_EQUAL_HEX16(111, bus.data(1, 0));
+    TEST_ASSERT_EQUAL_HEX8(CMD_NOP, bus.command(1, 1));
+    TEST_ASSERT_EQUAL_UINT32(2, chain->frames());
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_position_zero_gets_the_last_24_bits);
+    RUN_TEST(test_unused_positions_get_a_nop);
+    RUN_TEST(test_queue_waits_for_flush_and_sends_one_frame);
+    RUN_TEST(test_queueing_a_position_twice_sends_the_first_command);
+    RUN_TEST(test_write_now_leaves_the_queue_alone);
+    return UNITY_END();
+}
@@ -0,0 +1,149 @@
+/**************************************************************************/
+/*
+
+AdcStream on the host, fed by MockAdcBackend.
+
+Run with: pio test -e native
+
+The native environment builds none of lib/, so the stream's source is
+compiled into the test directly.
+
+*/
+/**************************************************************************/
+
+#include <unity.h>
+#include "AdcStream.cpp"
+#include "MockAdcBackend.hpp"
+
+#define CYCLES_PER_SAMPLE 6000
+
+static int16_t ramp(uint32_t index)
+{
+    return static_cast<int16_t>(index * 7 - 1000);
+}
+
+static MockAdcBackend backend(ramp, CYCLES_PER_SAMPLE);
+static AdcStream stream(&backend);
+
+void setUp(void)
+{
+    stream.end();
+    backend = MockAdcBackend(ramp, CYCLES_PER_SAMPLE);
+    TEST_ASSERT_TRUE(stream.begin(10000));
+}
+
+void tearDown(void)
+{
+    stream.end();
+}
+
+void test_pop_returns_samples_in_order_with_timestamps(void)
+{
+    backend.run(10);
+    TEST_ASSERT_EQUAL_UINT32(10, stream.available());
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        int16_t value = 0;
+        uint32_t cycles = 0;
+        TEST_ASSERT_TRUE(stream.pop(value, cycles));
+        TEST_ASSERT_EQUAL_INT16(ramp(i), value);
+        TEST_ASSERT_EQUAL_UINT32(i * CYCLES_PER_SAMPLE, cycles);
+    }
+    int16_t value = 0;
+    TEST_ASSERT_FALSE(stream.pop(value));
+    TEST_ASSERT_EQUAL_UINT32(0, stream.overruns());
+}
+
+void test_sample_in_flight_is_not_published(void)
+{
+    uint32_t start = stream.sequence(); // Counts on across begin()
+    TEST_ASSERT_TRUE(backend.tick());
+    TEST_ASSERT_EQUAL_UINT32(0, stream.available());
+    TEST_ASSERT_FALSE(backend.tick()); // Previous read still pending
+    TEST_ASSERT_EQUAL_UINT32(1, backend.missed());
+    TEST_ASSERT_TRUE(backend.complete());
+    TEST_ASSERT_EQUAL_UINT32(1, stream.available());
+    TEST_ASSERT_EQUAL_UINT32(start + 1, stream.sequence());
+}
+
+void test_overrun_keeps_the_newest_samples_and_counts_the_rest(void)
+{
+    const uint32_t extra = 5;
+    backend.run(ADC_STREAM_LENGTH + extra);
+    TEST_ASSERT_EQUAL_UINT32(ADC_STREAM_LENGTH - 1, stream.available());
+    int16_t value = 0;
+    uint32_t cycles = 0;
+    TEST_ASSERT_TRUE(stream.pop(value, cycles));
+    // The slot under the head may be rewritten at any time, so one more than
+    // the wrap is given up
+    TEST_ASSERT_EQUAL_UINT32(extra + 1, stream.overruns());
+    TEST_ASSERT_EQUAL_INT16(ramp(extra + 1), value);
+    TEST_ASSERT_EQUAL_UINT32((extra + 1) * CYCLES_PER_SAMPLE, cycles);
+    TEST_ASSERT_EQUAL_UINT32(ADC_STREAM_LENGTH - 2, stream.available());
+}
+
+void test_skip_to_keeps_the_newest_unread_samples(void)
+{
+    backend.run(100);
+    stream.skip_to(10);
+    TEST_ASSERT_EQUAL_UINT32(10, stream.available());
+    int16_t value = 0;
+    TEST_ASSERT_TRUE(stream.pop(value));
+    TEST_ASSERT_EQUAL_INT16(ramp(90), value);
+    stream.skip_to(50); // Fewer than keep unread, nothing to drop
+    TEST_ASSERT_EQUAL_UINT32(9, stream.available());
+    TEST_ASSERT_EQUAL_UINT32(0, stream.overruns());
+}
+
+void test_wait_next_returns_the_newest_sample_once(void)
+{
+    backend.run(3);
+    int16_t value = 0;
+    uint32_t cycles = 0;
+    TEST_ASSERT_TRUE(stream.wait_next(value, cycles, 100));
+    TEST_ASSERT_EQUAL_INT16(ramp(2), value);
+    TEST_ASSERT_EQUAL_UINT32(2 * CYCLES_PER_SAMPLE, cycles);
+    TEST_ASSERT_FALSE(stream.wait_next(value, 100)); // Nothing new: times out
+    TEST_ASSERT_EQUAL_UINT32(3, stream.available()); // pop() has its own read position
+    backend.run(1);
+    TEST_ASSERT_TRUE(stream.wait_next(value, 100));
+    TEST_ASSERT_EQUAL_INT16(ramp(3), value);
+}
+
+void test_latest_reports_sequence_and_timestamp(void)
+{
+    uint32_t start = stream.sequence();
+    backend.run(42);
+    uint32_t seq = 0;
+    uint32_t cycles = 0;
+    TEST_ASSERT_EQUAL_INT16(ramp(41), stream.latest(seq, cycles));
+    TEST_ASSERT_EQUAL_UINT32(start + 42, seq);
+    TEST_ASSERT_EQUAL_UINT32(41 * CYCLES_PER_SAMPLE, cycles);
+}
+
+void test_begin_discards_earlier_samples(void)
+{
+    backend.run(ADC_STREAM_LENGTH + 1);
+    int16_t value = 0;
+    TEST_ASSERT_TRUE(stream.pop(value));
+    TEST_ASSERT_TRUE(stream.begin(20000));
+    TEST_ASSERT_EQUAL_UINT32(20000, stream.rate_hz());
+    TEST_ASSERT_EQUAL_UINT32(0, stream.available());
+    TEST_ASSERT_EQUAL_UINT32(0, stream.overruns());
+    stream.end();
+    TEST_ASSERT_FALSE(stream.running());
+    TEST_ASSERT_FALSE(backend.tick()); // The backend was stopped
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pop_returns_samples_in_order_with_timestamps);
+    RUN_TEST(test_sample_in_flight_is_not_published);
+    RUN_TEST(test_overrun_keeps_the_newest_samples_and_counts_the_rest);
+    RUN_TEST(test_skip_to_keeps_the_newest_unread_samples);
+    RUN_TEST(test_wait_next_returns_the_newest_sample_once);
+    RUN_TEST(test_latest_reports_sequence_and_timestamp);
+    RUN_TEST(test_begin_discards_earlier_samples);
+    return UNITY_END();
+}
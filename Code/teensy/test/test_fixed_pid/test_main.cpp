@@ -0,0 +1,92 @@
+/**************************************************************************/
+/*
+
+FixedPidController on the host.
+
+Run with: pio test -e native
+
+The limits are the firmware's: FEEDBACK_Z_MIN - FEEDBACK_Z_MID up to
+FEEDBACK_Z_MAX - FEEDBACK_Z_MID.
+
+*/
+/**************************************************************************/
+
+#include <unity.h>
+#include "FixedPidController.cpp"
+
+#define Z_LOW (10000 - 32768)
+#define Z_HIGH (50000 - 32768)
+
+static FixedPidController pid;
+
+void setUp(void)
+{
+    pid = FixedPidController();
+    pid.set_gains(10.0, 0.1, 0.0);
+    pid.set_filter(0.8, 0.5);
+    pid.set_limits(Z_LOW, Z_HIGH);
+}
+
+void tearDown(void)
+{
+}
+
+void test_engage_holds_the_output_with_a_small_error(void)
+{
+    pid.engage(1234);
+    TEST_ASSERT_EQUAL_INT32(1234, pid.update(100000, 99900));
+}
+
+void test_engage_holds_the_output_with_a_large_error(void)
+{
+    // P alone is 100000, far beyond both the output and the integral limit
+    pid.engage(1234);
+    TEST_ASSERT_EQUAL_INT32(1234, pid.update(110000, 100000));
+    TEST_ASSERT_EQUAL_INT32(100000, pid.p_term());
+    TEST_ASSERT_EQUAL_INT32(1234 - 100000, pid.i_term());
+    // The next update moves by the integral step only, not to the clamp
+    TEST_ASSERT_INT32_WITHIN(1, 1234 + 1000, pid.update(110000, 100000));
+}
+
+void test_engage_holds_the_output_with_a_large_negative_error(void)
+{
+    pid.engage(-5000);
+    TEST_ASSERT_EQUAL_INT32(-5000, pid.update(100000, 110000));
+    TEST_ASSERT_INT32_WITHIN(1, -5000 - 1000, pid.update(100000, 110000));
+}
+
+void test_seeded_integrator_returns_to_the_usual_limit(void)
+{
+    pid.engage(1234);
+    pid.update(110000, 100000);
+    for (int i = 0; i < 1000; ++i)
+    {
+        pid.update(100000, 100000); // P drops out, the output saturates and back-calculation drains I
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(FIXED_PID_INTEGRAL_LIMIT, abs(pid.i_term()));
+    // Once back inside, the usual limit holds again
+    for (int i = 0; i < 1000; ++i)
+    {
+        pid.update(200000, 100000);
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(FIXED_PID_INTEGRAL_LIMIT, abs(pid.i_term()));
+}
+
+void test_output_stays_within_the_limits(void)
+{
+    pid.engage(0);
+    pid.update(100000, 100000);
+    TEST_ASSERT_EQUAL_INT32(Z_HIGH, pid.update(200000, 100000));
+    TEST_ASSERT_EQUAL_INT32(Z_LOW, pid.update(0, 100000));
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_engage_holds_the_output_with_a_small_error);
+    RUN_TEST(test_engage_holds_the_output_with_a_large_error);
+    RUN_TEST(test_engage_holds_the_output_with_a_large_negative_error);
+    RUN_TEST(test_seeded_integrator_returns_to_the_usual_limit);
+    RUN_TEST(test_output_stays_within_the_limits);
+    return UNITY_END();
+}